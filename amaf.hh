@@ -0,0 +1,80 @@
+#ifndef AMAF_HH
+#define AMAF_HH
+
+#include <cmath>
+#include "boarddata.hh"
+
+// All-moves-as-first statistics: a finished playout credits every cell
+// a side played in it, not only the move it started from.
+template<int N, int D>
+class AmafTable {
+ public:
+  AmafTable() : visits(0), score(0) {
+  }
+
+  constexpr static Position board_size = BoardData<N, D>::board_size;
+
+  // O(moves)
+  void update(Mark mark, Mark winner,
+      const vector<pair<Mark, Position>>& moves) {
+    int result = winner == mark ? 1 : winner == flip(mark) ? -1 : 0;
+    for (const auto& [player, pos] : moves) {
+      if (player == mark) {
+        visits[pos]++;
+        score[pos] += result;
+      }
+    }
+  }
+
+  AmafTable& operator+=(const AmafTable& that) {
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      visits[pos] += that.visits[pos];
+      score[pos] += that.score[pos];
+    }
+    return *this;
+  }
+
+  int get_visits(Position pos) const {
+    return visits[pos];
+  }
+
+  int get_score(Position pos) const {
+    return score[pos];
+  }
+
+  // Mixes the direct mean of n playouts with the AMAF mean, trusting
+  // AMAF less as n grows past the equivalence parameter k
+  // (beta = sqrt(k / (3n + k)), Gelly and Silver).
+  double blend(Position pos, double direct, int n, int k) const {
+    if (visits[pos] == 0) {
+      return direct;
+    }
+    double amaf = static_cast<double>(score[pos]) / visits[pos];
+    double beta = sqrt(static_cast<double>(k) / (3.0 * n + k));
+    return beta * amaf + (1.0 - beta) * direct;
+  }
+
+ private:
+  sarray<Position, int, board_size> visits;
+  sarray<Position, int, board_size> score;
+};
+
+// GameEngine post observer that records who played where.
+class MoveRecorder {
+ public:
+  MoveRecorder(Mark start, vector<pair<Mark, Position>>& moves)
+      : current(start), moves(moves) {
+  }
+  template<typename S>
+  void operator()(const S& state, optional<Position> pos) {
+    if (pos.has_value()) {
+      moves.emplace_back(current, *pos);
+    }
+    current = flip(current);
+  }
+ private:
+  Mark current;
+  vector<pair<Mark, Position>>& moves;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef BATCH_HH
+#define BATCH_HH
+
+#include <numeric>
+#include <span>
+#include "tictactoe.hh"
+
+// Many games advanced in lockstep: slot i pairs a state with the
+// positions open to the side to move there.
+template<int N, int D>
+struct GameBatch {
+  vector<const State<N, D>*> states;
+  vector<Bitfield<N, D>> open_positions;
+
+  int size() const {
+    return static_cast<int>(states.size());
+  }
+};
+
+// A batched strategy decides the empty slots of moves it can and leaves
+// the others alone, so strategies chain by running one after another.
+template<typename T>
+concept BatchStrategy = requires (
+    T x, const typename T::Batch& batch, span<optional<Position>> moves) {
+  x(Mark::X, batch, moves);
+};
+
+template<BatchStrategy A, BatchStrategy B>
+class BatchCombiner {
+ public:
+  using Batch = typename A::Batch;
+  BatchCombiner(A a, B b) : a(a), b(b) {
+  }
+  A a;
+  B b;
+  void operator()(
+      Mark mark, const Batch& batch, span<optional<Position>> moves) {
+    a(mark, batch, moves);
+    b(mark, batch, moves);
+  }
+};
+
+template<BatchStrategy A, BatchStrategy B>
+constexpr auto operator>>(A a, B b) {
+  return BatchCombiner<A, B>(a, b);
+}
+
+// Single-game strategies as a batched one; make_strategy builds the
+// strategy for a state, as GameEngine callers already do.
+template<int N, int D, typename F>
+class Batched {
+ public:
+  using Batch = GameBatch<N, D>;
+  explicit Batched(F make_strategy) : make_strategy(make_strategy) {
+  }
+  F make_strategy;
+  void operator()(
+      Mark mark, const Batch& batch, span<optional<Position>> moves) {
+    for (int i = 0; i < batch.size(); ++i) {
+      if (!moves[i].has_value()) {
+        auto strategy = make_strategy(*batch.states[i]);
+        moves[i] = strategy(mark, batch.open_positions[i]);
+      }
+    }
+  }
+};
+
+template<int N, int D, typename F>
+auto batched(F make_strategy) {
+  return Batched<N, D, F>(make_strategy);
+}
+
+// A batched strategy as a single-game Strategy, with a batch of one.
+template<int N, int D, BatchStrategy S>
+class Unbatched {
+ public:
+  Unbatched(const State<N, D>& state, S strategy)
+      : state(state), strategy(strategy) {
+  }
+  const State<N, D>& state;
+  S strategy;
+
+  template<typename B>
+  optional<Position> operator()(Mark mark, const B& open_positions) {
+    GameBatch<N, D> batch{{&state}, {open_positions}};
+    optional<Position> move;
+    strategy(mark, batch, span(&move, 1));
+    return move;
+  }
+};
+
+// Same answer as the single-game strategies: lowest open candidate.
+template<int N, int D>
+optional<Position> lowest(
+    const Bitfield<N, D>& candidates, const Bitfield<N, D>& open_positions) {
+  Bitfield<N, D> open = candidates;
+  open &= open_positions;
+  if (open.none()) {
+    optional<Position> empty = {};
+    return empty;
+  }
+  return open.first();
+}
+
+template<int N, int D>
+class BatchForcingMove {
+ public:
+  using Batch = GameBatch<N, D>;
+  void operator()(
+      Mark mark, const Batch& batch, span<optional<Position>> moves) {
+    for (Mark side : {mark, flip(mark)}) {
+      for (int i = 0; i < batch.size(); ++i) {
+        if (!moves[i].has_value()) {
+          moves[i] = lowest(batch.states[i]->get_winning_cells(side),
+                            batch.open_positions[i]);
+        }
+      }
+    }
+  }
+};
+
+template<int N, int D>
+class BatchForcingStrategy {
+ public:
+  using Batch = GameBatch<N, D>;
+  void operator()(
+      Mark mark, const Batch& batch, span<optional<Position>> moves) {
+    for (Mark side : {mark, flip(mark)}) {
+      for (int i = 0; i < batch.size(); ++i) {
+        if (!moves[i].has_value()) {
+          moves[i] = lowest(batch.states[i]->get_double_threats(side),
+                            batch.open_positions[i]);
+        }
+      }
+    }
+  }
+};
+
+template<int N, int D>
+class BatchBiasedRandom {
+ public:
+  using Batch = GameBatch<N, D>;
+  explicit BatchBiasedRandom(default_random_engine& generator)
+      : generator(generator) {
+  }
+  default_random_engine& generator;
+  void operator()(
+      Mark mark, const Batch& batch, span<optional<Position>> moves) {
+    for (int i = 0; i < batch.size(); ++i) {
+      if (!moves[i].has_value()) {
+        BiasedRandom random(*batch.states[i], generator);
+        moves[i] = random(mark, batch.open_positions[i]);
+      }
+    }
+  }
+};
+
+// GameEngine over a batch of games. Every game starts with the same mark
+// and marks alternate in lockstep; finished games drop out of the batch.
+template<int N, int D, BatchStrategy S>
+class BatchGameEngine {
+ public:
+  BatchGameEngine(span<State<N, D>> states, S strategy)
+      : states(states), strategy(strategy) {
+  }
+  span<State<N, D>> states;
+  S strategy;
+
+  // Winner of each game, Mark::empty for a draw.
+  vector<Mark> play(Mark start) {
+    vector<Mark> winners(states.size(), Mark::empty);
+    vector<int> active(states.size());
+    iota(begin(active), end(active), 0);
+    GameBatch<N, D> batch;
+    vector<optional<Position>> moves;
+    vector<int> playing;
+    Mark current_mark = start;
+    while (!active.empty()) {
+      batch.states.clear();
+      batch.open_positions.clear();
+      playing.clear();
+      for (int game : active) {
+        auto open_positions = states[game].get_open_positions(current_mark);
+        if (!open_positions.none()) {
+          playing.push_back(game);
+          batch.states.push_back(&states[game]);
+          batch.open_positions.push_back(open_positions);
+        }
+      }
+      moves.assign(playing.size(), {});
+      strategy(current_mark, batch, moves);
+      active.clear();
+      for (int i = 0; i < static_cast<int>(playing.size()); ++i) {
+        int game = playing[i];
+        if (moves[i].has_value() &&
+            states[game].play(*moves[i], current_mark)) {
+          winners[game] = current_mark;
+        } else {
+          active.push_back(game);
+        }
+      }
+      current_mark = flip(current_mark);
+    }
+    return winners;
+  }
+};
+
+#endif
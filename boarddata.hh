@@ -14,6 +14,7 @@
 #include <list>
 #include <ranges>
 #include "semantic.hh"
+#include "memory.hh"
 
 using namespace std;
 
@@ -61,6 +62,7 @@ class Geometry {
     construct_lines_through_position();
     construct_xor_table();
     construct_crossings();
+    construct_zobrist();
   }
 
   constexpr static Position board_size =
@@ -93,6 +95,10 @@ class Geometry {
     return _crossings;
   }
 
+  const sarray<Position, array<uint64_t, 2>, board_size>& zobrist() const {
+    return _zobrist;
+  }
+
   SideArray decode(Position pos) const {
     SideArray ans;
     for (Dim i = 0_dim; i < D; ++i) {
@@ -305,12 +311,20 @@ class Geometry {
     }
   }
 
+  void construct_zobrist() {
+    mt19937_64 generator(0x5eed);
+    for (auto& keys : _zobrist) {
+      keys = {generator(), generator()};
+    }
+  }
+
   vector<vector<Direction>> unique_terrains;
   WinningArray _winning_lines;
   sarray<Position, LineCount, board_size> _accumulation_points;
   vector<vector<Line>> _lines_through_position;
   sarray<Line, Position, line_size> _xor_table;
   sarray<Position, vector<pair<Line, Line>>, board_size> _crossings;
+  sarray<Position, array<uint64_t, 2>, board_size> _zobrist;
   Line current_winning;
 };
 
@@ -348,12 +362,23 @@ class Bitfield {
     bitfield |= that.bitfield;
     return *this;
   }
+  auto& operator&=(const Bitfield& that) {
+    bitfield &= that.bitfield;
+    return *this;
+  }
+  // Lowest set position, or board_size if empty.
+  Position first() const {
+    return Position{static_cast<int>(bitfield._Find_first())};
+  }
   void set(Position pos) {
     bitfield.set(pos);
   }
   void reset() {
     bitfield.reset();
   }
+  void reset(Position pos) {
+    bitfield.reset(pos);
+  }
   bool none() const {
     return bitfield.none();
   }
@@ -491,6 +516,7 @@ template<int N, int D>
 class SymmeTrie {
  public:
   explicit SymmeTrie(const Symmetry<N, D>& sym) : sym(sym) {
+    MEMORY_SCOPE(symmetrie);
     construct_trie();
     construct_mask();
   }
@@ -566,7 +592,7 @@ class SymmeTrie {
         vector<SymLine> next_similar;
         for (SymLine j = 0_sym; j < current_size; ++j) {
           if (i == sym.symmetries()[current[j]][i]) {
-            next_similar.push_back(j);
+            next_similar.push_back(current[j]);
           }
         }
         auto it = find_if(begin(nodes), end(nodes), [&](const auto& x) {
@@ -635,10 +661,18 @@ class BoardData {
     return sym.symmetries().size();
   }
 
+  const vector<vector<Position>>& symmetries() const {
+    return sym.symmetries();
+  }
+
   const CrossingArray& crossings() const {
     return geom.crossings();
   }
 
+  const sarray<Position, array<uint64_t, 2>, board_size>& zobrist() const {
+    return geom.zobrist();
+  }
+
   const sarray<Dim, Side, D> decode(Position pos) const {
     return geom.decode(pos);
   }
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
+#include "tictactoe.hh"
+#include "book.hh"
+
+// Usage: book [depth] [trials] [filename] [seed]
+// Analyzes every 5^3 opening up to depth plies with HeatMap and writes
+// the best moves to a book that heatmap loads at startup.
+int main(int argc, char **argv) {
+  unsigned seed = seed_argument(argc, argv, 4);
+  cerr << "seed " << seed << "\n";
+  int depth = argc > 1 ? stoi(argv[1]) : 3;
+  int trials = argc > 2 ? stoi(argv[2]) : 25;
+  string filename = argc > 3 ? argv[3] : "opening.book";
+  BoardData<5, 3> data;
+  default_random_engine generator(seed);
+  BookBuilder builder(data);
+  builder.build(depth, [&](const auto& state, Mark mark) {
+    auto open = state.get_open_positions(mark).get_vector();
+    HeatMap heatmap(state, data, generator, trials, false, 1000);
+    vector<int> scores = heatmap.get_scores(mark, open);
+    int best = distance(begin(scores), max_element(begin(scores), end(scores)));
+    return make_pair(open[best], scores[best]);
+  });
+  builder.write(filename);
+  cout << builder.size() << " positions written to " << filename << "\n";
+  return 0;
+}
@@ -0,0 +1,222 @@
+#ifndef BOOK_HH
+#define BOOK_HH
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "boarddata.hh"
+#include "state.hh"
+
+// On-disk layout: a BookHeader followed by count BookEntry records
+// sorted by key, so a book can be mapped and searched in place.
+struct BookHeader {
+  char magic[8];
+  int32_t n, d;
+  uint64_t count;
+};
+
+struct BookEntry {
+  // Canonical hash of the position and side to move.
+  uint64_t key;
+  // Best move in the frame of the canonical symmetry.
+  int16_t move;
+  int16_t score;
+  int32_t reserved;
+};
+
+constexpr char book_magic[8] = {'N', 'D', 'T', 'T', 'T', 'B', 'K', '1'};
+
+// Read-only book mapped from disk. A missing or malformed file gives an
+// empty book, so callers simply fall through to their search.
+template<int N, int D>
+class OpeningBook {
+ public:
+  OpeningBook(const BoardData<N, D>& data, const string& filename)
+      : data(data), mapped(nullptr), length(0), entries(nullptr), count(0) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 &&
+        info.st_size >= static_cast<off_t>(sizeof(BookHeader))) {
+      length = info.st_size;
+      mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+        mapped = nullptr;
+      }
+    }
+    ::close(fd);
+    if (mapped == nullptr) {
+      return;
+    }
+    const auto *header = static_cast<const BookHeader*>(mapped);
+    if (memcmp(header->magic, book_magic, sizeof(book_magic)) != 0 ||
+        header->n != N || header->d != D ||
+        length != sizeof(BookHeader) + header->count * sizeof(BookEntry)) {
+      return;
+    }
+    entries = reinterpret_cast<const BookEntry*>(header + 1);
+    count = header->count;
+  }
+
+  OpeningBook(const OpeningBook&) = delete;
+  OpeningBook& operator=(const OpeningBook&) = delete;
+
+  ~OpeningBook() {
+    if (mapped != nullptr) {
+      munmap(mapped, length);
+    }
+  }
+
+  constexpr static Position board_size = BoardData<N, D>::board_size;
+
+  int size() const {
+    return static_cast<int>(count);
+  }
+
+  // Book move for mark in this position, mapped back from the canonical
+  // frame. O(log size + symmetries * marks).
+  optional<Position> find(const State<N, D>& state, Mark mark) const {
+    if (auto entry = lookup(state, mark); entry.has_value()) {
+      return entry->first;
+    }
+    return {};
+  }
+
+  // Move and score of the entry for this position, if any; the move is
+  // empty for entries stored without one.
+  optional<pair<optional<Position>, int>> lookup(
+      const State<N, D>& state, Mark mark) const {
+    if (count == 0) {
+      return {};
+    }
+    auto [key, s] = canonical_hash(data, state, mark);
+    const BookEntry *it = lower_bound(entries, entries + count, key,
+        [](const BookEntry& entry, uint64_t key) {
+      return entry.key < key;
+    });
+    if (it == entries + count || it->key != key) {
+      return {};
+    }
+    optional<Position> move;
+    const auto& symmetry = data.symmetries()[s];
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      if (symmetry[pos] == Position{it->move}) {
+        move = pos;
+        break;
+      }
+    }
+    return make_pair(move, static_cast<int>(it->score));
+  }
+
+ private:
+  const BoardData<N, D>& data;
+  void *mapped;
+  size_t length;
+  const BookEntry *entries;
+  uint64_t count;
+};
+
+// Visits every position up to a depth from the empty board, once per
+// symmetry class, and records the move chosen by analyze(state, mark),
+// which returns the move and its score.
+template<int N, int D>
+class BookBuilder {
+ public:
+  explicit BookBuilder(const BoardData<N, D>& data) : data(data) {
+  }
+
+  template<typename F>
+  void build(int depth, F analyze) {
+    vector<State<N, D>> level{State<N, D>(data)};
+    Mark mark = Mark::X;
+    for (int ply = 0; ply < depth && !level.empty(); ++ply) {
+      vector<State<N, D>> next;
+      for (const auto& state : level) {
+        if (entries.contains(canonical_hash(data, state, mark).first)) {
+          continue;
+        }
+        auto open_positions = state.get_open_positions(mark);
+        if (open_positions.none()) {
+          continue;
+        }
+        auto [best, score] = analyze(state, mark);
+        insert(state, mark, best, score);
+        if (ply + 1 == depth) {
+          continue;
+        }
+        for (Position pos : open_positions.all()) {
+          State<N, D> child(state);
+          if (!child.play(pos, mark)) {
+            next.push_back(child);
+          }
+        }
+      }
+      cout << "ply " << ply << " : " << entries.size() << " positions\n";
+      level = move(next);
+      mark = flip(mark);
+    }
+  }
+
+  int size() const {
+    return static_cast<int>(entries.size());
+  }
+
+  // Records move (stored in the canonical frame) and score for the
+  // position; an empty move is stored as -1.
+  void insert(const State<N, D>& state, Mark mark,
+      optional<Position> move, int score) {
+    auto [key, s] = canonical_hash(data, state, mark);
+    int16_t canonical_move = move.has_value() ?
+        static_cast<int16_t>(data.symmetries()[s][*move]) : -1;
+    entries[key] = BookEntry{
+        key, canonical_move, static_cast<int16_t>(score), 0};
+  }
+
+  void write(const string& filename) const {
+    ofstream ofs(filename, ios::binary);
+    BookHeader header;
+    memcpy(header.magic, book_magic, sizeof(book_magic));
+    header.n = N;
+    header.d = D;
+    header.count = entries.size();
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& [key, entry] : entries) {
+      ofs.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    }
+  }
+
+ private:
+  const BoardData<N, D>& data;
+  map<uint64_t, BookEntry> entries;
+};
+
+// Answers from the book and leaves every other position to the rest of
+// the chain: BookStrategy(state, book) >> ForcingMove(state) >> ...
+template<int N, int D>
+class BookStrategy {
+ public:
+  BookStrategy(const State<N, D>& state, const OpeningBook<N, D>& book)
+      : state(state), book(book) {
+  }
+  const State<N, D>& state;
+  const OpeningBook<N, D>& book;
+
+  template<typename B>
+  optional<Position> operator()(Mark mark, const B& open_positions) {
+    auto move = book.find(state, mark);
+    if (move.has_value() && state.get_board(*move) == Mark::empty) {
+      return move;
+    }
+    optional<Position> empty = {};
+    return empty;
+  }
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef FENWICK_HH
+#define FENWICK_HH
+
+#include "boarddata.hh"
+
+template<int N, int D>
+class FenwickTree {
+ public:
+  constexpr static Position board_size = BoardData<N, D>::board_size;
+
+  explicit FenwickTree(const sarray<Position, LineCount, board_size>& weights)
+      : tree{} {
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      tree[pos + 1] += weights[pos];
+      int parent = pos + 1 + lowbit(pos + 1);
+      if (parent <= board_size) {
+        tree[parent] += tree[pos + 1];
+      }
+    }
+  }
+  // O(log n)
+  void add(Position pos, int delta) {
+    for (int i = pos + 1; i <= board_size; i += lowbit(i)) {
+      tree[i] += delta;
+    }
+  }
+  // O(log n)
+  int prefix(Position pos) const {
+    int sum = 0;
+    for (int i = pos; i > 0; i -= lowbit(i)) {
+      sum += tree[i];
+    }
+    return sum;
+  }
+  // O(log n)
+  int total() const {
+    return prefix(board_size);
+  }
+  // O(log n)
+  // Smallest position whose inclusive prefix sum is greater than value.
+  Position find(int value) const {
+    int pos = 0;
+    for (int step = top_bit; step > 0; step >>= 1) {
+      if (pos + step <= board_size && tree[pos + step] <= value) {
+        pos += step;
+        value -= tree[pos];
+      }
+    }
+    return Position{pos};
+  }
+ private:
+  constexpr static int lowbit(int i) {
+    return i & -i;
+  }
+  constexpr static int highest_bit(int i) {
+    int bit = 1;
+    while (bit * 2 <= i) {
+      bit *= 2;
+    }
+    return bit;
+  }
+  constexpr static int top_bit = highest_bit(board_size);
+  array<int, board_size + 1> tree;
+};
+
+#endif
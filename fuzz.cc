@@ -0,0 +1,71 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
+#include "tictactoe.hh"
+#include "reference.hh"
+
+// Long-running differential test: random games on State and on the
+// naive ReferenceState until a disagreement or the game count runs out.
+// Game g is seeded with (seed, g), so a failure names what reproduces
+// it, and its moves are written as a record file (record.hh).
+template<int N, int D>
+int fuzz(long long games, unsigned seed) {
+  BoardData<N, D> data;
+  auto start = chrono::steady_clock::now();
+  auto last_report = start;
+  long long plies = 0;
+  for (long long game = 0; games == 0 || game < games; ++game) {
+    seed_seq sequence{seed, static_cast<unsigned>(game)};
+    default_random_engine generator(sequence);
+    GameRecord record;
+    auto found = differential_game<N, D, State<N, D>>(data, generator, record);
+    plies += record.moves.size();
+    if (found.has_value()) {
+      cout << N << "^" << D << " seed " << seed << " game " << game << ": "
+           << *found << "\n";
+      ofstream ofs("fuzz.fail", ios::binary);
+      GameRecordFormat<N, D>::write_header(ofs);
+      GameRecordFormat<N, D>::write(ofs, record);
+      cout << "moves written to fuzz.fail\n";
+      return 1;
+    }
+    auto now = chrono::steady_clock::now();
+    if (now - last_report > chrono::seconds(1)) {
+      double elapsed = chrono::duration<double>(now - start).count();
+      cerr << elapsed << "s: " << game + 1 << " games, " << plies
+           << " plies, " << (game + 1) / elapsed << " games/s\n";
+      last_report = now;
+    }
+  }
+  cout << N << "^" << D << " seed " << seed << " : " << games
+       << " games, " << plies << " plies agree\n";
+  return 0;
+}
+
+// Usage: fuzz [board] [games] [seed]
+// Board is one of 3x3, 4x4, 3x3x3, 4x4x4, 5x5x5, 4x4x4x4; zero games
+// runs until stopped or until a disagreement.
+int main(int argc, char **argv) {
+  unsigned seed = seed_argument(argc, argv, 3);
+  string board = argc > 1 ? argv[1] : "5x5x5";
+  long long games = argc > 2 ? stoll(argv[2]) : 0;
+  if (board == "3x3") {
+    return fuzz<3, 2>(games, seed);
+  } else if (board == "4x4") {
+    return fuzz<4, 2>(games, seed);
+  } else if (board == "3x3x3") {
+    return fuzz<3, 3>(games, seed);
+  } else if (board == "4x4x4") {
+    return fuzz<4, 3>(games, seed);
+  } else if (board == "5x5x5") {
+    return fuzz<5, 3>(games, seed);
+  } else if (board == "4x4x4x4") {
+    return fuzz<4, 4>(games, seed);
+  }
+  cerr << "unknown board " << board << "\n";
+  return 1;
+}
@@ -0,0 +1,133 @@
+#ifndef HEATCACHE_HH
+#define HEATCACHE_HH
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <limits>
+#include <unordered_map>
+#include "boarddata.hh"
+#include "state.hh"
+
+// LRU cache of HeatMap scores, shared by all nodes of a search.
+// Positions are stored in canonical form, so a position and all its
+// symmetric images share one entry.
+template<int N, int D>
+class HeatMapCache {
+ public:
+  explicit HeatMapCache(const BoardData<N, D>& data, int capacity = 1 << 16)
+      : data(data), capacity(capacity), hits(0), misses(0) {
+  }
+
+  constexpr static Position board_size = BoardData<N, D>::board_size;
+  using Key = bitset<2 * board_size + 1>;
+
+  // Returns the scores of the open positions, calling compute(open) only
+  // when some of them are not already known for this position.
+  template<typename F>
+  vector<int> get_scores(const State<N, D>& state, Mark mark,
+      const vector<Position>& open, F compute) {
+    auto [key, transforms] = canonical(state, mark);
+    const auto& first = data.symmetries()[transforms.front()];
+    {
+      lock_guard<mutex> guard(lock);
+      auto it = index.find(key);
+      if (it != index.end()) {
+        const auto& scores = it->second->second;
+        if (all_of(begin(open), end(open), [&](Position pos) {
+              return scores[first[pos]] != missing;
+            })) {
+          entries.splice(begin(entries), entries, it->second);
+          hits++;
+          vector<int> ans(open.size());
+          transform(begin(open), end(open), begin(ans), [&](Position pos) {
+            return scores[first[pos]];
+          });
+          return ans;
+        }
+      }
+      misses++;
+    }
+    vector<int> ans = compute(open);
+    lock_guard<mutex> guard(lock);
+    auto it = index.find(key);
+    if (it == index.end()) {
+      entries.emplace_front(key, vector<int>(board_size, missing));
+      it = index.emplace(key, begin(entries)).first;
+      evict();
+    } else {
+      entries.splice(begin(entries), entries, it->second);
+    }
+    auto& scores = it->second->second;
+    // Every symmetry that reaches the canonical form fixes the position,
+    // so store the score under each of them; a symmetric position whose
+    // open list picked another cell of the same orbit will still hit.
+    for (SymLine s : transforms) {
+      const auto& symmetry = data.symmetries()[s];
+      for (int i = 0; i < static_cast<int>(open.size()); ++i) {
+        scores[symmetry[open[i]]] = ans[i];
+      }
+    }
+    return ans;
+  }
+
+  // Read without the lock, e.g. by a progress report during a search.
+  long long get_hits() const {
+    return hits;
+  }
+
+  long long get_misses() const {
+    return misses;
+  }
+
+  int size() const {
+    lock_guard<mutex> guard(lock);
+    return index.size();
+  }
+
+ private:
+  constexpr static int missing = numeric_limits<int>::min();
+
+  pair<Key, vector<SymLine>> canonical(
+      const State<N, D>& state, Mark mark) const {
+    sarray<Position, Mark, board_size> best(Mark::both);
+    vector<SymLine> transforms;
+    sarray<Position, Mark, board_size> current;
+    const auto& symmetries = data.symmetries();
+    for (SymLine s = 0_sym; s < static_cast<int>(symmetries.size()); ++s) {
+      for (Position pos = 0_pos; pos < board_size; ++pos) {
+        current[symmetries[s][pos]] = state.get_board(pos);
+      }
+      if (current < best) {
+        best = current;
+        transforms.clear();
+      }
+      if (current == best) {
+        transforms.push_back(s);
+      }
+    }
+    Key key;
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      key[2 * pos] = best[pos] == Mark::X;
+      key[2 * pos + 1] = best[pos] == Mark::O;
+    }
+    key[2 * board_size] = mark == Mark::O;
+    return make_pair(key, transforms);
+  }
+
+  void evict() {
+    while (static_cast<int>(entries.size()) > capacity) {
+      index.erase(entries.back().first);
+      entries.pop_back();
+    }
+  }
+
+  const BoardData<N, D>& data;
+  const int capacity;
+  atomic<long long> hits, misses;
+  mutable mutex lock;
+  list<pair<Key, vector<int>>> entries;
+  unordered_map<Key, typename list<pair<Key, vector<int>>>::iterator> index;
+};
+
+#endif
@@ -10,24 +10,39 @@
 #include <execution>
 #include <list>
 #include "tictactoe.hh"
+#include "book.hh"
 
-int main() {
+// Usage: heatmap [seed]
+int main(int argc, char **argv) {
   BoardData<5, 3> data;
-  unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+  unsigned seed = seed_argument(argc, argv, 1);
+  cerr << "seed " << seed << "\n";
   default_random_engine generator(seed);
   State state(data);
+  // Built by "make opening.book"; without it every move is searched.
+  OpeningBook<5, 3> book(data, "opening.book");
+  cout << "book positions " << book.size() << "\n";
   auto s =
+      BookStrategy(state, book) >>
       ForcingMove(state) >>
       ForcingStrategy(state, data) >>
-      HeatMap(state, data, generator, 100, true);
+      HeatMap(state, data, generator, 25, true, 1000);
   //auto s = HeatMap(state, data, generator);
   GameEngine b(generator, state, s);
   int current = 0;
+  auto ply_start = chrono::steady_clock::now();
+  double total = 0.0;
   b.play(Mark::X, [&](auto obs) {
     cout << "\x1b[0m\n\nlevel " << current++ << "\n";
+    ply_start = chrono::steady_clock::now();
   }, [&](const auto& state, auto pos) {
+    double elapsed = chrono::duration<double>(
+        chrono::steady_clock::now() - ply_start).count();
+    total += elapsed;
+    cout << "ply time " << elapsed * 1e3 << " ms\n";
     state.print_last_position(*pos);
   });
+  cout << "\nper-ply cost " << total * 1e3 / current << " ms\n";
   cout << "\nfinal\n";
   state.print_winner();
   return 0;
@@ -0,0 +1,246 @@
+#ifndef MEMORY_HH
+#define MEMORY_HH
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <string>
+
+// Heap bytes by subsystem. Code about to allocate for a subsystem opens a
+// MEMORY_SCOPE; with MEMORY defined the global operator new charges each
+// allocation to the innermost scope of its thread, and operator delete
+// gives the bytes back to the same tag, whichever scope frees them.
+// Without MEMORY the scopes compile to nothing. Included by boarddata.hh,
+// so like semantic.hh it spells out std::.
+enum class MemoryTag {
+  other,
+  solution_tree,
+  symmetrie,
+  minimax,
+  heatmap,
+  size
+};
+
+constexpr int memory_tag_count = static_cast<int>(MemoryTag::size);
+
+using MemoryCaps = std::array<long long, memory_tag_count>;
+
+inline const char *memory_tag_name(MemoryTag tag) {
+  constexpr const char *names[memory_tag_count] = {
+      "other", "solution_tree", "symmetrie", "minimax", "heatmap"};
+  return names[static_cast<int>(tag)];
+}
+
+// Reads caps written as "tag=size,tag=size", sizes in bytes or with a K,
+// M or G suffix. Tags left out have no cap (zero).
+inline std::optional<MemoryCaps> parse_memory_caps(const std::string& text) {
+  MemoryCaps caps = {};
+  std::istringstream iss(text);
+  std::string item;
+  while (std::getline(iss, item, ',')) {
+    auto equals = item.find('=');
+    if (equals == std::string::npos) {
+      return {};
+    }
+    std::string name = item.substr(0, equals);
+    int tag = 0;
+    while (tag < memory_tag_count &&
+           name != memory_tag_name(static_cast<MemoryTag>(tag))) {
+      tag++;
+    }
+    std::istringstream size(item.substr(equals + 1));
+    long long bytes;
+    if (tag == memory_tag_count || !(size >> bytes) || bytes < 0) {
+      return {};
+    }
+    char suffix;
+    if (size >> suffix) {
+      auto unit = std::string("KMG").find(suffix);
+      if (unit == std::string::npos || size >> suffix) {
+        return {};
+      }
+      bytes <<= 10 * (unit + 1);
+    }
+    caps[tag] = bytes;
+  }
+  return caps;
+}
+
+#ifdef MEMORY
+
+// Totals are shared by all threads, one cache line per tag. Everything
+// here is constant-initialized, since operator new runs before main.
+class MemoryAccount {
+ public:
+  static MemoryAccount& instance() {
+    static MemoryAccount account;
+    return account;
+  }
+
+  void allocated(MemoryTag tag, size_t bytes) {
+    Counter& counter = counters[static_cast<int>(tag)];
+    long long now = counter.current.fetch_add(
+        bytes, std::memory_order_relaxed) + bytes;
+    long long peak = counter.peak.load(std::memory_order_relaxed);
+    while (now > peak && !counter.peak.compare_exchange_weak(
+        peak, now, std::memory_order_relaxed)) {
+    }
+    long long cap = counter.cap.load(std::memory_order_relaxed);
+    if (cap > 0 && now > cap) {
+      over.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  void freed(MemoryTag tag, size_t bytes) {
+    counters[static_cast<int>(tag)].current.fetch_sub(
+        bytes, std::memory_order_relaxed);
+  }
+
+  // A cap is checked when its tag allocates; zero means no cap.
+  void set_caps(const MemoryCaps& caps) {
+    for (int i = 0; i < memory_tag_count; ++i) {
+      counters[i].cap.store(caps[i], std::memory_order_relaxed);
+    }
+  }
+
+  // Set once any tag has gone over its cap, and stays set.
+  bool over_cap() const {
+    return over.load(std::memory_order_relaxed);
+  }
+
+  // One line of current/peak kilobytes for each tag that has allocated.
+  void print(std::ostream& os) const {
+    os << "memory kB";
+    for (int i = 0; i < memory_tag_count; ++i) {
+      const Counter& counter = counters[i];
+      long long peak = counter.peak.load(std::memory_order_relaxed);
+      if (peak == 0) {
+        continue;
+      }
+      long long current = counter.current.load(std::memory_order_relaxed);
+      long long cap = counter.cap.load(std::memory_order_relaxed);
+      os << " " << memory_tag_name(static_cast<MemoryTag>(i)) << " "
+         << (current >> 10) << "/" << (peak >> 10);
+      if (cap > 0) {
+        os << (peak > cap ? " OVER " : " cap ") << (cap >> 10);
+      }
+    }
+    os << "\n";
+  }
+
+ private:
+  struct alignas(64) Counter {
+    std::atomic<long long> current{0}, peak{0}, cap{0};
+  };
+
+  std::array<Counter, memory_tag_count> counters;
+  std::atomic<bool> over{false};
+};
+
+inline thread_local MemoryTag memory_scope_tag = MemoryTag::other;
+
+class MemoryScope {
+ public:
+  explicit MemoryScope(MemoryTag tag) : saved(memory_scope_tag) {
+    memory_scope_tag = tag;
+  }
+
+  ~MemoryScope() {
+    memory_scope_tag = saved;
+  }
+
+ private:
+  MemoryTag saved;
+};
+
+// Every block starts with its size and tag, so delete needs neither.
+// Sixteen bytes keep the alignment malloc gives. These, and the aligned
+// forms used by types aligned to more than sixteen bytes, replace the
+// global operators and are not inline, so a MEMORY build may only have
+// one translation unit, as every binary here does. Inlined, they make
+// the compiler see the header as out of bounds of the object allocated.
+struct alignas(16) MemoryHeader {
+  size_t size;
+  MemoryTag tag;
+};
+
+__attribute__((noinline)) void *operator new(size_t size) {
+  void *block = std::malloc(sizeof(MemoryHeader) + size);
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  auto *header = new (block) MemoryHeader{size, memory_scope_tag};
+  MemoryAccount::instance().allocated(header->tag, size);
+  return header + 1;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+  if (p == nullptr) {
+    return;
+  }
+  auto *header = static_cast<MemoryHeader*>(p) - 1;
+  MemoryAccount::instance().freed(header->tag, header->size);
+  std::free(header);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  operator delete(p);
+}
+
+// Over-aligned blocks put the header just before the first aligned
+// address past it; delete gets the same alignment to find the start.
+inline size_t memory_header_offset(std::align_val_t align) {
+  return std::max(static_cast<size_t>(align), sizeof(MemoryHeader));
+}
+
+__attribute__((noinline)) void *operator new(
+    size_t size, std::align_val_t align) {
+  size_t offset = memory_header_offset(align);
+  size_t alignment = static_cast<size_t>(align);
+  size_t total = (offset + size + alignment - 1) / alignment * alignment;
+  auto *block = static_cast<char*>(std::aligned_alloc(alignment, total));
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  auto *header = new (block + offset - sizeof(MemoryHeader))
+      MemoryHeader{size, memory_scope_tag};
+  MemoryAccount::instance().allocated(header->tag, size);
+  return header + 1;
+}
+
+__attribute__((noinline)) void operator delete(
+    void *p, std::align_val_t align) noexcept {
+  if (p == nullptr) {
+    return;
+  }
+  auto *header = static_cast<MemoryHeader*>(p) - 1;
+  MemoryAccount::instance().freed(header->tag, header->size);
+  std::free(static_cast<char*>(p) - memory_header_offset(align));
+}
+
+void operator delete(void *p, size_t, std::align_val_t align) noexcept {
+  operator delete(p, align);
+}
+
+#define MEMORY_JOIN(a, b) a##b
+#define MEMORY_NAME(line) MEMORY_JOIN(memory_scope_, line)
+#define MEMORY_SCOPE(tag) MemoryScope MEMORY_NAME(__LINE__)(MemoryTag::tag)
+#define MEMORY_CAPS(caps) MemoryAccount::instance().set_caps(caps)
+#define MEMORY_OVER_CAP() MemoryAccount::instance().over_cap()
+#define MEMORY_PRINT(os) MemoryAccount::instance().print(os)
+
+#else
+
+#define MEMORY_SCOPE(tag) do {} while (0)
+#define MEMORY_CAPS(caps) do {} while (0)
+#define MEMORY_OVER_CAP() false
+#define MEMORY_PRINT(os) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef METRICS_HH
+#define METRICS_HH
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "boarddata.hh"
+
+// Search counters, read by a background MetricsReporter. Everything here
+// compiles to nothing unless METRICS is defined, so the hot paths pay
+// nothing in normal builds.
+enum class Metric {
+  nodes,
+  forced_moves,
+  heatmap_calls,
+  chaining_nodes,
+  // Gauges: the largest value any thread has set.
+  chaining_record,
+  depth,
+  size
+};
+
+constexpr int metric_count = static_cast<int>(Metric::size);
+
+inline bool is_gauge(Metric metric) {
+  return metric >= Metric::chaining_record;
+}
+
+inline const char *metric_name(Metric metric) {
+  constexpr const char *names[metric_count] = {
+      "nodes", "forced", "heatmaps", "chaining", "record", "depth"};
+  return names[static_cast<int>(metric)];
+}
+
+using MetricValues = array<long long, metric_count>;
+
+#ifdef METRICS
+
+// One block of counters per thread, written only by that thread, so an
+// update is a plain relaxed load and store on a line of its own. Blocks
+// outlive their threads, keeping the totals of finished workers.
+class MetricRegistry {
+ public:
+  struct alignas(64) Counters {
+    array<atomic<long long>, metric_count> values = {};
+  };
+
+  static MetricRegistry& instance() {
+    static MetricRegistry registry;
+    return registry;
+  }
+
+  static Counters& local() {
+    thread_local Counters *counters = instance().allocate();
+    return *counters;
+  }
+
+  // Sums counters and takes the largest gauge over all threads.
+  MetricValues snapshot() {
+    lock_guard<mutex> guard(lock);
+    MetricValues total = {};
+    for (const auto& counters : blocks) {
+      for (int i = 0; i < metric_count; ++i) {
+        long long value = counters->values[i].load(memory_order_relaxed);
+        total[i] = is_gauge(static_cast<Metric>(i)) ?
+            max(total[i], value) : total[i] + value;
+      }
+    }
+    return total;
+  }
+
+ private:
+  Counters *allocate() {
+    lock_guard<mutex> guard(lock);
+    blocks.push_back(make_unique<Counters>());
+    return blocks.back().get();
+  }
+
+  mutex lock;
+  deque<unique_ptr<Counters>> blocks;
+};
+
+inline void metric_add(Metric metric, long long amount) {
+  auto& value = MetricRegistry::local().values[static_cast<int>(metric)];
+  value.store(value.load(memory_order_relaxed) + amount,
+              memory_order_relaxed);
+}
+
+inline void metric_set(Metric metric, long long amount) {
+  MetricRegistry::local().values[static_cast<int>(metric)].store(
+      amount, memory_order_relaxed);
+}
+
+inline void metric_max(Metric metric, long long amount) {
+  auto& value = MetricRegistry::local().values[static_cast<int>(metric)];
+  if (amount > value.load(memory_order_relaxed)) {
+    value.store(amount, memory_order_relaxed);
+  }
+}
+
+#define METRIC_ADD(metric, amount) metric_add(Metric::metric, amount)
+#define METRIC_SET(metric, amount) metric_set(Metric::metric, amount)
+#define METRIC_MAX(metric, amount) metric_max(Metric::metric, amount)
+
+// Samples the registry every interval on its own thread and writes one
+// line per sample: counter totals, gauges, and nodes per second since
+// the previous line.
+class MetricsReporter {
+ public:
+  MetricsReporter(ostream& os, chrono::milliseconds interval)
+      : os(os), interval(interval), stopping(false),
+        sampler([this] { run(); }) {
+  }
+
+  MetricsReporter(const MetricsReporter&) = delete;
+  MetricsReporter& operator=(const MetricsReporter&) = delete;
+
+  ~MetricsReporter() {
+    {
+      lock_guard<mutex> guard(lock);
+      stopping = true;
+    }
+    wake.notify_one();
+    sampler.join();
+  }
+
+ private:
+  void run() {
+    auto start = chrono::steady_clock::now();
+    auto previous = start;
+    long long previous_nodes = 0;
+    unique_lock<mutex> guard(lock);
+    bool last = false;
+    while (!last) {
+      last = wake.wait_for(guard, interval, [this] { return stopping; });
+      auto now = chrono::steady_clock::now();
+      MetricValues values = MetricRegistry::instance().snapshot();
+      long long nodes = values[static_cast<int>(Metric::nodes)];
+      double elapsed = chrono::duration<double>(now - previous).count();
+      os << "metrics t " << chrono::duration<double>(now - start).count();
+      for (int i = 0; i < metric_count; ++i) {
+        os << " " << metric_name(static_cast<Metric>(i)) << " " << values[i];
+      }
+      double rate = elapsed > 0 ? (nodes - previous_nodes) / elapsed : 0;
+      os << " nodes/s " << rate << "\n";
+      MEMORY_PRINT(os);
+      os.flush();
+      previous = now;
+      previous_nodes = nodes;
+    }
+  }
+
+  ostream& os;
+  chrono::milliseconds interval;
+  mutex lock;
+  condition_variable wake;
+  bool stopping;
+  thread sampler;
+};
+
+#else
+
+#define METRIC_ADD(metric, amount) do {} while (0)
+#define METRIC_SET(metric, amount) do {} while (0)
+#define METRIC_MAX(metric, amount) do {} while (0)
+
+class MetricsReporter {
+ public:
+  MetricsReporter(ostream& os, chrono::milliseconds interval) {
+  }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+#include <random>
+#include "tictactoe.hh"
+#include "elevator.hh"
+#include "tracking.hh"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+// Moves of one BiasedRandom game from a fixed seed, up to its end or
+// the given number of plies.
+template<int N, int D>
+vector<Position> fixed_game(const BoardData<N, D>& data, int plies) {
+  default_random_engine generator(1);
+  State<N, D> state(data);
+  BiasedRandom random(state, generator);
+  vector<Position> moves;
+  Mark mark = Mark::X;
+  for (int ply = 0; ply < plies; ++ply) {
+    auto open_positions = state.get_open_positions(mark);
+    if (open_positions.none()) {
+      break;
+    }
+    auto move = random(mark, open_positions);
+    if (!move.has_value() || state.play(*move, mark)) {
+      break;
+    }
+    moves.push_back(*move);
+    mark = flip(mark);
+  }
+  return moves;
+}
+
+// A position a quarter of the board into a fixed game, X to move.
+template<int N, int D>
+State<N, D> midgame(const BoardData<N, D>& data) {
+  State<N, D> state(data);
+  Mark mark = Mark::X;
+  auto moves = fixed_game(data, data.board_size / 4);
+  moves.resize(moves.size() & ~1);
+  for (Position pos : moves) {
+    state.play(pos, mark);
+    mark = flip(mark);
+  }
+  return state;
+}
+
+template<int N, int D>
+void BM_BoardData(benchmark::State& bench) {
+  for (auto _ : bench) {
+    BoardData<N, D> data;
+    const auto *built = &data;
+    benchmark::DoNotOptimize(built);
+    benchmark::ClobberMemory();
+  }
+}
+
+// A fresh copy of the empty State, then every move of a fixed game.
+template<int N, int D>
+void BM_StatePlay(benchmark::State& bench) {
+  BoardData<N, D> data;
+  State<N, D> empty(data);
+  auto moves = fixed_game(data, data.board_size);
+  for (auto _ : bench) {
+    State<N, D> state(empty);
+    Mark mark = Mark::X;
+    for (Position pos : moves) {
+      benchmark::DoNotOptimize(state.play(pos, mark));
+      mark = flip(mark);
+    }
+  }
+  bench.SetItemsProcessed(bench.iterations() * moves.size());
+}
+
+template<int N, int D>
+void BM_StateCopy(benchmark::State& bench) {
+  BoardData<N, D> data;
+  State<N, D> state = midgame(data);
+  for (auto _ : bench) {
+    State<N, D> cloned(state);
+    benchmark::DoNotOptimize(cloned);
+  }
+}
+
+template<int N, int D>
+void BM_GetOpenPositions(benchmark::State& bench) {
+  BoardData<N, D> data;
+  State<N, D> state = midgame(data);
+  for (auto _ : bench) {
+    benchmark::DoNotOptimize(state.get_open_positions(Mark::X));
+  }
+}
+
+template<int N, int D>
+void BM_BitfieldAll(benchmark::State& bench) {
+  BoardData<N, D> data;
+  auto open_positions = midgame(data).get_open_positions(Mark::X);
+  for (auto _ : bench) {
+    int sum = 0;
+    for (Position pos : open_positions.all()) {
+      sum += pos;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  bench.SetItemsProcessed(bench.iterations() * open_positions.count());
+}
+
+template<int N, int D>
+void BM_ForcingStrategy(benchmark::State& bench) {
+  BoardData<N, D> data;
+  State<N, D> state = midgame(data);
+  auto open_positions = state.get_open_positions(Mark::X);
+  for (auto _ : bench) {
+    benchmark::DoNotOptimize(
+        ForcingStrategy(state, data)(Mark::X, open_positions));
+  }
+}
+
+// One mark added to and removed from every line.
+template<int N, int D>
+void BM_ElevatorUpdate(benchmark::State& bench) {
+  Elevator<N, D> elevator;
+  constexpr Line line_size = BoardData<N, D>::line_size;
+  for (auto _ : bench) {
+    for (Line line = 0_line; line < line_size; ++line) {
+      elevator[line] += Mark::X;
+    }
+    for (Line line = 0_line; line < line_size; ++line) {
+      elevator[line] -= Mark::X;
+    }
+    benchmark::ClobberMemory();
+  }
+  bench.SetItemsProcessed(bench.iterations() * 2 * line_size);
+}
+
+template<int N, int D>
+void BM_ElevatorIterate(benchmark::State& bench) {
+  Elevator<N, D> elevator;
+  constexpr Line line_size = BoardData<N, D>::line_size;
+  for (auto _ : bench) {
+    int sum = 0;
+    for (Line line : elevator.all(0_mcount, Mark::empty)) {
+      sum += line;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  bench.SetItemsProcessed(bench.iterations() * line_size);
+}
+
+// A fresh copy of the full list, then every position removed.
+template<int N, int D>
+void BM_TrackingListRemove(benchmark::State& bench) {
+  TrackingList<N, D> full;
+  constexpr Position board_size = BoardData<N, D>::board_size;
+  for (auto _ : bench) {
+    TrackingList<N, D> tracking(full);
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      tracking.remove(pos);
+    }
+    benchmark::DoNotOptimize(tracking);
+  }
+  bench.SetItemsProcessed(bench.iterations() * board_size);
+}
+
+#define BOARDS(name) \
+  BENCHMARK_TEMPLATE(name, 3, 2); \
+  BENCHMARK_TEMPLATE(name, 4, 2); \
+  BENCHMARK_TEMPLATE(name, 3, 3); \
+  BENCHMARK_TEMPLATE(name, 4, 3); \
+  BENCHMARK_TEMPLATE(name, 5, 3)
+
+BOARDS(BM_BoardData);
+BOARDS(BM_StatePlay);
+BOARDS(BM_StateCopy);
+BOARDS(BM_GetOpenPositions);
+BOARDS(BM_BitfieldAll);
+BOARDS(BM_ForcingStrategy);
+BOARDS(BM_ElevatorUpdate);
+BOARDS(BM_ElevatorIterate);
+BOARDS(BM_TrackingListRemove);
+
+}
+
+BENCHMARK_MAIN();
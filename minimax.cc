@@ -9,11 +9,39 @@
 #include <bitset>
 #include <execution>
 #include <list>
+#include <fstream>
+#include <string>
 #include "tictactoe.hh"
 
-int main() {
+// Usage: minimax [metrics log] [interval ms] [memory caps] [seed]
+//        minimax --seed N [metrics log] [interval ms] [memory caps]
+// The log, stderr by default, is only written by builds with METRICS
+// ("make minimaxm"). Builds with TRACE ("make minimaxt") write trace.json,
+// sampling 20ms out of every 200ms. Builds with MEMORY ("make minimaxmem")
+// report heap bytes per subsystem and take caps such as
+// "solution_tree=2G,heatmap=100M"; going over one writes the tree found
+// so far to solution.partial.txt and exits. "-" skips an argument.
+int main(int argc, char **argv) {
+  unsigned seed = seed_argument(argc, argv, 4);
+  cerr << "seed " << seed << "\n";
+  string log = argc > 1 ? argv[1] : "-";
+  int interval = argc > 2 ? stoi(argv[2]) : 1000;
+  if (argc > 3 && string(argv[3]) != "-") {
+    auto caps = parse_memory_caps(argv[3]);
+    if (!caps.has_value()) {
+      cerr << "bad memory caps " << argv[3] << "\n";
+      return 1;
+    }
+    MEMORY_CAPS(*caps);
+  }
+  ofstream log_file;
+  if (log != "-") {
+    log_file.open(log);
+  }
+  MetricsReporter reporter(log == "-" ? cerr : log_file,
+      chrono::milliseconds(interval));
+  TRACE_CONFIGURE(chrono::milliseconds(20), chrono::milliseconds(200));
   BoardData<3, 2> data;
-  unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
   default_random_engine generator(seed);
   State state(data);
   auto minimax = MiniMax(state, data, generator);
@@ -26,5 +54,9 @@ int main() {
     cout << "Draw\n";
   }
   minimax.get_solution().dump(data, "solution.txt");
+  // Read by reporter.py.
+  ofstream stats("search_stats.json");
+  minimax.get_stats().write_json(stats);
+  TRACE_WRITE("trace.json");
   return 0;
 }
@@ -0,0 +1,158 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <map>
+#include <string>
+#include <sys/resource.h>
+#include "tictactoe.hh"
+
+// Fixed workloads for "make bench". Each run is one process, so the peak
+// RSS belongs to its workload alone, and prints one line:
+//   name seconds nodes nodes_per_second peak_kb
+
+// Discards cout (MiniMax progress) while alive.
+class Quiet {
+ public:
+  Quiet() : saved(cout.rdbuf(nullptr)) {
+  }
+  ~Quiet() {
+    cout.rdbuf(saved);
+  }
+ private:
+  streambuf *saved;
+};
+
+// Small boards are solved several times to get past timer noise.
+template<int N, int D>
+long long solve(unsigned seed, int repeats) {
+  BoardData<N, D> data;
+  long long nodes = 0;
+  Quiet quiet;
+  for (int i = 0; i < repeats; ++i) {
+    default_random_engine generator(seed);
+    State state(data);
+    MiniMax minimax(state, data, generator);
+    minimax.play(state, Mark::X);
+    nodes += minimax.nodes_visited;
+  }
+  return nodes;
+}
+
+// Moves played in games of the forcing chain.
+template<int N, int D>
+long long playouts(unsigned seed, int games) {
+  BoardData<N, D> data;
+  default_random_engine generator(seed);
+  long long moves = 0;
+  for (int i = 0; i < games; ++i) {
+    State state(data);
+    GameEngine engine(generator, state,
+        ForcingMove(state) >>
+        ForcingStrategy(state, data) >>
+        BiasedRandom(state, generator));
+    engine.play(Mark::X, [&](const auto& open_positions) {
+      moves++;
+    }, [](const auto& x, auto y){});
+  }
+  return moves;
+}
+
+int run(const string& workload) {
+  const unsigned seed = 1;
+  auto start = chrono::steady_clock::now();
+  long long nodes;
+  if (workload == "solve4x4") {
+    nodes = solve<4, 2>(seed, 1);
+  } else if (workload == "solve3x3x3") {
+    nodes = solve<3, 3>(seed, 50);
+  } else if (workload == "playout5x5x5") {
+    nodes = playouts<5, 3>(seed, 20000);
+  } else {
+    cerr << "unknown workload " << workload << "\n";
+    return 1;
+  }
+  double elapsed = chrono::duration<double>(
+      chrono::steady_clock::now() - start).count();
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  cout << workload << " " << elapsed << " " << nodes << " "
+       << nodes / elapsed << " " << usage.ru_maxrss << "\n";
+  return 0;
+}
+
+struct Sample {
+  double seconds;
+  long long nodes;
+  double rate;
+  long long peak_kb;
+};
+
+map<string, Sample> read_samples(const string& filename) {
+  map<string, Sample> samples;
+  ifstream ifs(filename);
+  string name;
+  Sample sample;
+  while (ifs >> name >> sample.seconds >> sample.nodes >> sample.rate
+             >> sample.peak_kb) {
+    samples[name] = sample;
+  }
+  return samples;
+}
+
+// Flags every workload whose time or peak RSS grew by more than threshold
+// (a fraction), and every baseline workload the current run lacks; fails
+// if any did. Node rates are not compared: with the node count fixed they
+// only restate the time.
+int compare(const string& baseline, const string& current, double threshold) {
+  auto before = read_samples(baseline);
+  auto after = read_samples(current);
+  bool regressed = false;
+  for (const auto& [name, then] : before) {
+    if (!after.contains(name)) {
+      cout << name << ": missing from current run  REGRESSION\n";
+      regressed = true;
+    }
+  }
+  for (const auto& [name, now] : after) {
+    auto it = before.find(name);
+    if (it == before.end()) {
+      cout << name << ": not in baseline\n";
+      continue;
+    }
+    const Sample& then = it->second;
+    auto check = [&](const string& what, double old_value, double new_value) {
+      double change = old_value > 0 ? new_value / old_value - 1.0 : 0.0;
+      bool worse = change > threshold;
+      regressed |= worse;
+      cout << name << " " << what << " " << old_value << " -> " << new_value
+           << " (" << showpos << 100 * change << noshowpos << "%)"
+           << (worse ? "  REGRESSION" : "") << "\n";
+    };
+    check("seconds", then.seconds, now.seconds);
+    check("peak_kb", then.peak_kb, now.peak_kb);
+    if (then.nodes != now.nodes) {
+      cout << name << " nodes " << then.nodes << " -> " << now.nodes
+           << " (search changed)\n";
+    }
+  }
+  return regressed ? 1 : 0;
+}
+
+// Usage: perfbench workload
+//        perfbench compare baseline current [threshold]
+int main(int argc, char **argv) {
+  if (argc > 3 && string(argv[1]) == "compare") {
+    double threshold = argc > 4 ? stod(argv[4]) : 0.10;
+    return compare(argv[2], argv[3], threshold);
+  }
+  if (argc != 2) {
+    cerr << "usage: perfbench solve4x4|solve3x3x3|playout5x5x5\n"
+         << "       perfbench compare baseline current [threshold]\n";
+    return 1;
+  }
+  return run(argv[1]);
+}
@@ -10,15 +10,109 @@
 #include <bitset>
 #include <execution>
 #include <list>
+#include <string>
 #include "tictactoe.hh"
+#include "selfplay.hh"
 
-int main() {
+// Widest confidence interval over the plies with at least min_samples
+// games, which the rare longest games never reach.
+template<int N, int D>
+double widest(const SelfPlayStats<N, D>& stats, long long min_samples) {
+  double width = numeric_limits<double>::infinity();
+  for (int i = 0; i <= stats.board_size && stats.reached[i] >= min_samples;
+       ++i) {
+    width = i == 0 ? 0.0 : width;
+    width = max(width, 2 * stats.branching_error(i));
+  }
+  return width;
+}
+
+// Plays the chain on every core until the 95% interval of the mean
+// branching at every ply is narrower than target, reporting as it goes,
+// then prints the per-ply means and, for the uniform chain only, Knuth's
+// estimate of the tree size. Other chains pick some lines more often
+// than others, which the plain product of branching factors ignores.
+template<int N, int D>
+int estimate(const string& chain, double target, unsigned seed) {
+  BoardData<N, D> data;
+  const long long min_samples = 100;
+  bool uniform = chain == "uniform";
+  bool known = with_named_chain(data, chain, [&](auto make_strategy) {
+    SelfPlay<N, D, decltype(make_strategy)> runner(data, make_strategy, seed);
+    auto start = chrono::steady_clock::now();
+    auto report = [&](const auto& stats) {
+      double elapsed = chrono::duration<double>(
+          chrono::steady_clock::now() - start).count();
+      cerr << elapsed << "s: " << stats.games << " games, widest interval "
+           << widest(stats, min_samples);
+      if (uniform) {
+        cerr << ", tree 10^" << log10(stats.knuth_mean());
+      }
+      cerr << "\n";
+    };
+    auto stats = runner.run_until(numeric_limits<long long>::max(),
+        chrono::milliseconds(500), report, [&](const auto& stats) {
+      return widest(stats, min_samples) < target;
+    });
+    report(stats);
+    double total = 0.0;
+    for (int i = 0; i <= stats.board_size && stats.reached[i] > 0; ++i) {
+      cout << i << "\t" << stats.mean_branching(i) << "\t"
+           << stats.branching_error(i) << "\n";
+      total += log10(max(1.0, stats.mean_branching(i)));
+    }
+    cerr << "product of mean branching : 10^" << total << "\n";
+    if (!uniform) {
+      cerr << "no Knuth tree size for chain " << chain << "\n";
+      return;
+    }
+    long double knuth = stats.knuth_mean(), error = stats.knuth_error();
+    cerr << "Knuth tree size : 10^" << log10(knuth) << " nodes, 95% in [10^"
+         << log10(max(1.0L, knuth - error)) << ", 10^"
+         << log10(knuth + error) << "]\n";
+  });
+  if (!known) {
+    cerr << "unknown chain " << chain << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+// Usage: phasediag [seed]
+//        phasediag estimate [board] [chain] [width] [seed]
+// The estimate mode runs until every ply's branching is known to within
+// width. Only the uniform chain also gets Knuth's tree size estimate,
+// which is biased for any chain whose moves are not uniform.
+// Otherwise, plays 100 BiasedRandom games on 5^3.
+int main(int argc, char **argv) {
+  bool estimating = argc > 1 && string(argv[1]) == "estimate";
+  unsigned seed = seed_argument(argc, argv, estimating ? 5 : 1);
+  cerr << "seed " << seed << "\n";
+  if (argc > 1 && string(argv[1]) == "estimate") {
+    string board = argc > 2 ? argv[2] : "5x5x5";
+    string chain = argc > 3 ? argv[3] : "uniform";
+    double width = argc > 4 ? stod(argv[4]) : 0.1;
+    if (board == "3x3") {
+      return estimate<3, 2>(chain, width, seed);
+    } else if (board == "4x4") {
+      return estimate<4, 2>(chain, width, seed);
+    } else if (board == "3x3x3") {
+      return estimate<3, 3>(chain, width, seed);
+    } else if (board == "4x4x4") {
+      return estimate<4, 3>(chain, width, seed);
+    } else if (board == "5x5x5") {
+      return estimate<5, 3>(chain, width, seed);
+    }
+    cerr << "unknown board " << board << "\n";
+    return 1;
+  }
   BoardData<5, 3> data;
   vector<int> search_tree(data.board_size);
-  unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
   default_random_engine generator(seed);
   int max_plays = 100;
   vector<int> win_counts(3);
+  int plies = 0;
+  auto start = chrono::steady_clock::now();
   for (int i = 0; i < max_plays; ++i) {
     State state(data);
     GameEngine b(generator, state,
@@ -30,7 +124,11 @@ int main() {
       search_tree[level++] += open_positions.count();
     }, [](const auto& x, auto y){});
     win_counts[static_cast<int>(winner)]++;
+    plies += level;
   }
+  auto end = chrono::steady_clock::now();
+  double elapsed = chrono::duration<double>(end - start).count();
+  cerr << "per-ply cost: " << elapsed * 1e6 / plies << " us\n";
   double total = 0.0;
   for (int i = 0; i < static_cast<int>(search_tree.size()); ++i) {
     double level = static_cast<double>(search_tree[i]) / max_plays;
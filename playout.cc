@@ -0,0 +1,148 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <set>
+#include <queue>
+#include <cassert>
+#include <bitset>
+#include <execution>
+#include <list>
+#include "tictactoe.hh"
+#include "batch.hh"
+
+template<int N, int D, typename F>
+void benchmark(const BoardData<N, D>& data,
+    default_random_engine& generator, string name, int max_plays,
+    F make_strategy) {
+  auto start = chrono::steady_clock::now();
+  int moves = 0;
+  for (int i = 0; i < max_plays; ++i) {
+    State state(data);
+    GameEngine b(generator, state, make_strategy(state));
+    b.play(Mark::X, [&](const auto& open_positions) {
+      moves++;
+    }, [](const auto& x, auto y){});
+  }
+  auto end = chrono::steady_clock::now();
+  double elapsed = chrono::duration<double>(end - start).count();
+  cout << N << "^" << D << " " << name << " : " << max_plays
+       << " playouts in " << elapsed << "s, " << max_plays / elapsed
+       << " playouts/s, " << moves / elapsed << " moves/s\n";
+}
+
+// Same playouts as the forcing chain above, batch_size games at a time.
+template<int N, int D>
+void batch_benchmark(const BoardData<N, D>& data,
+    default_random_engine& generator, int max_plays, int batch_size) {
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < max_plays; i += batch_size) {
+    vector<State<N, D>> states(batch_size, State(data));
+    BatchGameEngine engine(span<State<N, D>>(states),
+        BatchForcingMove<N, D>() >>
+        BatchForcingStrategy<N, D>() >>
+        BatchBiasedRandom<N, D>(generator));
+    engine.play(Mark::X);
+  }
+  auto end = chrono::steady_clock::now();
+  double elapsed = chrono::duration<double>(end - start).count();
+  cout << N << "^" << D << " batched forcing chain x" << batch_size << " : "
+       << max_plays << " playouts in " << elapsed << "s, "
+       << max_plays / elapsed << " playouts/s\n";
+}
+
+// Fraction of plies where RolloutPolicy finds the same forced move as
+// ForcingMove >> ForcingStrategy, along games played by the latter.
+template<int N, int D>
+void agreement(const BoardData<N, D>& data,
+    default_random_engine& generator, int max_plays) {
+  int agree = 0, total = 0;
+  for (int i = 0; i < max_plays; ++i) {
+    State state(data);
+    auto chain = ForcingMove(state) >> ForcingStrategy(state, data);
+    RolloutPolicy policy(state, generator);
+    GameEngine b(generator, state,
+        ForcingMove(state) >>
+        ForcingStrategy(state, data) >>
+        BiasedRandom(state, generator));
+    Mark current = Mark::X;
+    b.play(current, [&](const auto& open_positions) {
+      agree += chain(current, open_positions) ==
+               policy.forced(current, open_positions);
+      total++;
+      current = flip(current);
+    }, [](const auto& x, auto y){});
+  }
+  cout << N << "^" << D << " agreement : " << agree << " / " << total << "\n";
+}
+
+// Cost of a ForcingStrategy call on random positions after the given
+// number of plies, without the rest of the playout around it.
+template<int N, int D>
+void forcing_cost(const BoardData<N, D>& data,
+    default_random_engine& generator, int plies, int positions) {
+  vector<State<N, D>> states;
+  while (static_cast<int>(states.size()) < positions) {
+    State state(data);
+    BiasedRandom random(state, generator);
+    Mark mark = Mark::X;
+    bool finished = false;
+    for (int ply = 0; ply < plies && !finished; ++ply) {
+      auto move = random(mark, state.get_open_positions(mark));
+      finished = !move.has_value() || state.play(*move, mark);
+      mark = flip(mark);
+    }
+    if (!finished) {
+      states.push_back(state);
+    }
+  }
+  auto start = chrono::steady_clock::now();
+  int found = 0;
+  const int repeats = 100;
+  for (int i = 0; i < repeats; ++i) {
+    for (const auto& state : states) {
+      auto open_positions = state.get_open_positions(Mark::X);
+      found += ForcingStrategy(state, data)(
+          Mark::X, open_positions).has_value();
+    }
+  }
+  auto end = chrono::steady_clock::now();
+  double elapsed = chrono::duration<double>(end - start).count();
+  cout << N << "^" << D << " ForcingStrategy after " << plies << " plies : "
+       << elapsed * 1e9 / (repeats * positions) << " ns/call, "
+       << found / repeats << " / " << positions << " forced\n";
+}
+
+template<int N, int D>
+void run(default_random_engine& generator, int max_plays) {
+  BoardData<N, D> data;
+  benchmark(data, generator, "BiasedRandom", max_plays,
+      [&](const auto& state) {
+    return BiasedRandom(state, generator);
+  });
+  benchmark(data, generator, "ForcingMove >> ForcingStrategy >> BiasedRandom",
+      max_plays, [&](const auto& state) {
+    return
+        ForcingMove(state) >>
+        ForcingStrategy(state, data) >>
+        BiasedRandom(state, generator);
+  });
+  batch_benchmark(data, generator, max_plays, 64);
+  benchmark(data, generator, "RolloutPolicy", max_plays,
+      [&](const auto& state) {
+    return RolloutPolicy(state, generator);
+  });
+  agreement(data, generator, max_plays / 10);
+  forcing_cost(data, generator, data.board_size / 4, 1000);
+}
+
+// Usage: playout [seed]
+int main(int argc, char **argv) {
+  unsigned seed = seed_argument(argc, argv, 1);
+  cerr << "seed " << seed << "\n";
+  default_random_engine generator(seed);
+  run<5, 3>(generator, 20000);
+  run<4, 4>(generator, 20000);
+  return 0;
+}
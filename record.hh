@@ -0,0 +1,154 @@
+#ifndef RECORD_HH
+#define RECORD_HH
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include "boarddata.hh"
+
+// Binary game records. A file is a GameRecordHeader followed by games,
+// each a GameRecordPrefix and then one move per ply: a byte on boards of
+// fewer than 255 cells, two bytes otherwise, all ones for a pass.
+// Integers are written in host byte order, as in the book and tablebase.
+struct GameRecordHeader {
+  char magic[8];
+  int32_t n, d;
+};
+
+struct GameRecordPrefix {
+  // Marks as stored by static_cast<uint8_t>.
+  uint8_t start, winner;
+  uint16_t plies;
+};
+
+constexpr char game_record_magic[8] = {'N', 'D', 'T', 'T', 'T', 'G', 'R', '1'};
+
+// One game as GameEngine played it; an empty move is a pass.
+struct GameRecord {
+  Mark start = Mark::X;
+  Mark winner = Mark::empty;
+  vector<optional<Position>> moves;
+};
+
+template<int N, int D>
+class GameRecordFormat {
+ public:
+  constexpr static Position board_size = BoardData<N, D>::board_size;
+  using Move = conditional_t<(board_size < 255), uint8_t, uint16_t>;
+  constexpr static Move pass = static_cast<Move>(~Move(0));
+
+  static void write_header(ostream& os) {
+    GameRecordHeader header;
+    memcpy(header.magic, game_record_magic, sizeof(game_record_magic));
+    header.n = N;
+    header.d = D;
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+
+  // False unless the stream starts with the header of an N^D file.
+  static bool read_header(istream& is) {
+    GameRecordHeader header;
+    return is.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+        memcmp(header.magic, game_record_magic,
+               sizeof(game_record_magic)) == 0 &&
+        header.n == N && header.d == D;
+  }
+
+  static void write(ostream& os, const GameRecord& record) {
+    GameRecordPrefix prefix{static_cast<uint8_t>(record.start),
+        static_cast<uint8_t>(record.winner),
+        static_cast<uint16_t>(record.moves.size())};
+    os.write(reinterpret_cast<const char*>(&prefix), sizeof(prefix));
+    vector<Move> moves(record.moves.size());
+    transform(begin(record.moves), end(record.moves), begin(moves),
+        [](optional<Position> pos) {
+      return pos.has_value() ? static_cast<Move>(*pos) : pass;
+    });
+    os.write(reinterpret_cast<const char*>(moves.data()),
+             moves.size() * sizeof(Move));
+  }
+
+  // Reads the next game into record; false at the end of the stream or
+  // on a truncated or malformed game.
+  static bool read(istream& is, GameRecord& record) {
+    GameRecordPrefix prefix;
+    if (!is.read(reinterpret_cast<char*>(&prefix), sizeof(prefix)) ||
+        prefix.start > 2 || prefix.winner > 2) {
+      return false;
+    }
+    vector<Move> moves(prefix.plies);
+    if (!is.read(reinterpret_cast<char*>(moves.data()),
+                 moves.size() * sizeof(Move))) {
+      return false;
+    }
+    record.start = static_cast<Mark>(prefix.start);
+    record.winner = static_cast<Mark>(prefix.winner);
+    record.moves.clear();
+    for (Move move : moves) {
+      if (move == pass) {
+        record.moves.emplace_back();
+      } else if (move < board_size) {
+        record.moves.emplace_back(static_cast<Position>(move));
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+// GameEngine post observer that fills a record with every ply, passes
+// included. The caller sets start and winner.
+class GameRecorder {
+ public:
+  explicit GameRecorder(GameRecord& record) : record(record) {
+  }
+  template<typename S>
+  void operator()(const S& state, optional<Position> pos) {
+    record.moves.push_back(pos);
+  }
+ private:
+  GameRecord& record;
+};
+
+// Plays the moves of a record back through GameEngine; the game must
+// start with record.start. If the board disagrees with the record (a
+// recorded move is not open, or the moves run out before the game ends)
+// it sets diverged and plays the first open position from then on, so
+// the game still ends.
+class ReplayStrategy {
+ public:
+  explicit ReplayStrategy(const GameRecord& record)
+      : record(record), ply(0), diverged(false) {
+  }
+  template<typename B>
+  optional<Position> operator()(Mark mark, const B& open_positions) {
+    if (!diverged && ply < record.moves.size()) {
+      optional<Position> move = record.moves[ply++];
+      if (!move.has_value() || open_positions[*move]) {
+        return move;
+      }
+    }
+    diverged = true;
+    for (Position pos : open_positions.all()) {
+      return pos;
+    }
+    return {};
+  }
+  bool has_diverged() const {
+    return diverged;
+  }
+  // After the game: whether it followed the record to its last move,
+  // neither diverging nor ending with recorded moves left over.
+  bool followed_record() const {
+    return !diverged && ply == record.moves.size();
+  }
+ private:
+  const GameRecord& record;
+  size_t ply;
+  bool diverged;
+};
+
+#endif
@@ -0,0 +1,328 @@
+#ifndef REFERENCE_HH
+#define REFERENCE_HH
+
+#include <optional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include "boarddata.hh"
+#include "record.hh"
+
+// Naive oracle for State: keeps only the board and answers every query
+// by scanning winning_lines(), so it is slow but obviously right. It
+// answers with State's semantics, quirks included (double threats count
+// occupied cells, accumulation counts played cells).
+template<int N, int D>
+class ReferenceState {
+ public:
+  explicit ReferenceState(const BoardData<N, D>& data)
+      : data(data), board(Mark::empty) {
+  }
+
+  constexpr static Position board_size = BoardData<N, D>::board_size;
+  constexpr static Line line_size = BoardData<N, D>::line_size;
+
+  bool play(Position pos, Mark mark) {
+    board[pos] = mark;
+    played.push_back(pos);
+    for (const auto& line : data.winning_lines()) {
+      if (all_of(begin(line), end(line), [&](Position p) {
+            return board[p] == mark; })) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Mark get_board(Position pos) const {
+    return board[pos];
+  }
+
+  // How many marks the line holds, and which: empty, X, O or both.
+  pair<MarkCount, Mark> get_line_marks(Line line) const {
+    int count = 0, marks = 0;
+    for (Position pos : data.winning_lines()[line]) {
+      if (board[pos] != Mark::empty) {
+        count++;
+        marks |= static_cast<int>(board[pos]);
+      }
+    }
+    return make_pair(MarkCount{count}, static_cast<Mark>(marks));
+  }
+
+  // Lines through pos that do not hold both marks.
+  int get_current_accumulation(Position pos) const {
+    int count = 0;
+    for (Line line = 0_line; line < line_size; ++line) {
+      const auto& cells = data.winning_lines()[line];
+      if (find(begin(cells), end(cells), pos) != end(cells) &&
+          get_line_marks(line).second != Mark::both) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  // Empty and still on some line either side can complete.
+  bool is_live(Position pos) const {
+    return board[pos] == Mark::empty && get_current_accumulation(pos) > 0;
+  }
+
+  int get_empty_count() const {
+    int count = 0;
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      count += is_live(pos);
+    }
+    return count;
+  }
+
+  int get_total_weight() const {
+    int total = 0;
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      if (board[pos] == Mark::empty) {
+        total += get_current_accumulation(pos);
+      }
+    }
+    return total;
+  }
+
+  // XOR of the empty cells of the line.
+  Position get_xor_table(Line line) const {
+    int ans = 0;
+    for (Position pos : data.winning_lines()[line]) {
+      if (board[pos] == Mark::empty) {
+        ans ^= static_cast<int>(pos);
+      }
+    }
+    return Position{ans};
+  }
+
+  Bitfield<N, D> get_winning_cells(Mark mark) const {
+    Bitfield<N, D> cells;
+    for (Line line = 0_line; line < line_size; ++line) {
+      if (get_line_marks(line) == make_pair(MarkCount{N - 1}, mark)) {
+        cells.set(get_xor_table(line));
+      }
+    }
+    return cells;
+  }
+
+  // Cells on two or more lines holding N-2 of mark and nothing else.
+  Bitfield<N, D> get_double_threats(Mark mark) const {
+    sarray<Position, int, board_size> lines(0);
+    for (Line line = 0_line; line < line_size; ++line) {
+      if (get_line_marks(line) == make_pair(MarkCount{N - 2}, mark)) {
+        for (Position pos : data.winning_lines()[line]) {
+          lines[pos]++;
+        }
+      }
+    }
+    Bitfield<N, D> cells;
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      if (lines[pos] >= 2) {
+        cells.set(pos);
+      }
+    }
+    return cells;
+  }
+
+  // The smallest live cell of each orbit under the symmetries that fix
+  // every played cell.
+  Bitfield<N, D> get_open_positions(Mark mark) const {
+    vector<const vector<Position>*> fixing;
+    for (const auto& symmetry : data.symmetries()) {
+      if (all_of(begin(played), end(played), [&](Position pos) {
+            return symmetry[pos] == pos; })) {
+        fixing.push_back(&symmetry);
+      }
+    }
+    Bitfield<N, D> open;
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      if (is_live(pos) && all_of(begin(fixing), end(fixing),
+            [&](const auto *symmetry) { return (*symmetry)[pos] >= pos; })) {
+        open.set(pos);
+      }
+    }
+    return open;
+  }
+
+  uint64_t get_hash() const {
+    uint64_t hash = 0;
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      if (board[pos] != Mark::empty) {
+        hash ^= data.zobrist()[pos][board[pos] == Mark::X ? 0 : 1];
+      }
+    }
+    return hash;
+  }
+
+ private:
+  const BoardData<N, D>& data;
+  sarray<Position, Mark, board_size> board;
+  vector<Position> played;
+};
+
+// Describes the first query on which backend disagrees with the oracle,
+// if any. A backend is anything with State's query interface.
+template<int N, int D, typename B>
+optional<string> find_disagreement(
+    const ReferenceState<N, D>& reference, const B& backend, Mark mark) {
+  constexpr Position board_size = BoardData<N, D>::board_size;
+  constexpr Line line_size = BoardData<N, D>::line_size;
+  ostringstream oss;
+  auto cells = [](const Bitfield<N, D>& field) {
+    string ans;
+    for (Position pos : field.all()) {
+      ans += " " + to_string(static_cast<int>(pos));
+    }
+    return ans;
+  };
+  auto differ = [&](const string& what, auto expected, auto actual) {
+    oss << what << ": expected " << expected << " got " << actual;
+    return oss.str();
+  };
+  for (Position pos = 0_pos; pos < board_size; ++pos) {
+    if (backend.get_board(pos) != reference.get_board(pos)) {
+      return differ("board " + to_string(static_cast<int>(pos)),
+          static_cast<int>(reference.get_board(pos)),
+          static_cast<int>(backend.get_board(pos)));
+    }
+    if (backend.get_current_accumulation(pos) !=
+        reference.get_current_accumulation(pos)) {
+      return differ("accumulation " + to_string(static_cast<int>(pos)),
+          reference.get_current_accumulation(pos),
+          static_cast<int>(backend.get_current_accumulation(pos)));
+    }
+  }
+  for (Line line = 0_line; line < line_size; ++line) {
+    auto [count, marks] = reference.get_line_marks(line);
+    if (!backend.check_line(line, count, marks)) {
+      return differ("floor of line " + to_string(static_cast<int>(line)),
+          to_string(static_cast<int>(count)) + " of mark " +
+          to_string(static_cast<int>(marks)), "another floor");
+    }
+    if (backend.get_xor_table(line) != reference.get_xor_table(line)) {
+      return differ("xor of line " + to_string(static_cast<int>(line)),
+          static_cast<int>(reference.get_xor_table(line)),
+          static_cast<int>(backend.get_xor_table(line)));
+    }
+  }
+  // Every floor of the elevator lists exactly its lines.
+  for (int m = 0; m <= static_cast<int>(Mark::both); ++m) {
+    Mark marks = static_cast<Mark>(m);
+    for (MarkCount count = 0_mcount; count <= N; ++count) {
+      set<Line> expected, actual;
+      for (Line line = 0_line; line < line_size; ++line) {
+        if (reference.get_line_marks(line) == make_pair(count, marks)) {
+          expected.insert(line);
+        }
+      }
+      for (Line line : backend.get_line_marks(count, marks)) {
+        actual.insert(line);
+      }
+      if (expected != actual ||
+          backend.empty(count, marks) != expected.empty() ||
+          backend.one(count, marks) != (expected.size() == 1)) {
+        return differ("lines with " + to_string(static_cast<int>(count)) +
+            " of mark " + to_string(m), expected.size(), actual.size());
+      }
+    }
+  }
+  if (backend.get_empty_count() != reference.get_empty_count()) {
+    return differ("live cells", reference.get_empty_count(),
+        backend.get_empty_count());
+  }
+  if (backend.get_total_weight() != reference.get_total_weight()) {
+    return differ("total weight", reference.get_total_weight(),
+        backend.get_total_weight());
+  }
+  if (backend.get_hash() != reference.get_hash()) {
+    return differ("hash", reference.get_hash(), backend.get_hash());
+  }
+  for (Mark side : {Mark::X, Mark::O}) {
+    string name = side == Mark::X ? " of X" : " of O";
+    auto wins = reference.get_winning_cells(side);
+    if (cells(backend.get_winning_cells(side)) != cells(wins)) {
+      return differ("winning cells" + name, cells(wins),
+          cells(backend.get_winning_cells(side)));
+    }
+    auto threats = reference.get_double_threats(side);
+    if (cells(backend.get_double_threats(side)) != cells(threats)) {
+      return differ("double threats" + name, cells(threats),
+          cells(backend.get_double_threats(side)));
+    }
+  }
+  auto open = reference.get_open_positions(mark);
+  if (cells(backend.get_open_positions(mark)) != cells(open)) {
+    return differ("open positions", cells(open),
+        cells(backend.get_open_positions(mark)));
+  }
+  return {};
+}
+
+// Plays one game of random moves on the oracle and on a fresh instance
+// of each backend, comparing all of them before the first move and after
+// every move, wins included. Moves are drawn from every live cell rather
+// than the symmetry-reduced ones, to reach positions strategies skip.
+// The moves played go to record, so a failing game can be replayed.
+template<int N, int D, typename... Backends>
+optional<string> differential_game(const BoardData<N, D>& data,
+    default_random_engine& generator, GameRecord& record) {
+  constexpr Position board_size = BoardData<N, D>::board_size;
+  ReferenceState<N, D> reference(data);
+  tuple<Backends...> backends{Backends(data)...};
+  record = GameRecord();
+  Mark mark = Mark::X;
+  optional<string> found;
+  auto compare = [&] {
+    int index = 0;
+    apply([&](const auto&... backend) {
+      ((found.has_value() ? void() : [&] {
+        if (auto difference = find_disagreement(reference, backend, mark);
+            difference.has_value()) {
+          found = "backend " + to_string(index) + ", ply " +
+              to_string(record.moves.size()) + ": " + *difference;
+        }
+        index++;
+      }()), ...);
+    }, backends);
+  };
+  compare();
+  while (!found.has_value()) {
+    vector<Position> live;
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      if (reference.is_live(pos)) {
+        live.push_back(pos);
+      }
+    }
+    if (live.empty()) {
+      break;
+    }
+    uniform_int_distribution<int> choice(0, live.size() - 1);
+    Position pos = live[choice(generator)];
+    record.moves.push_back(pos);
+    bool expected = reference.play(pos, mark);
+    int index = 0;
+    apply([&](auto&... backend) {
+      ((found.has_value() ? void() : [&] {
+        if (backend.play(pos, mark) != expected) {
+          found = "backend " + to_string(index) + ", ply " +
+              to_string(record.moves.size()) + ": win " +
+              (expected ? "missed" : "reported");
+        }
+        index++;
+      }()), ...);
+    }, backends);
+    if (expected) {
+      record.winner = mark;
+      break;
+    }
+    mark = flip(mark);
+    compare();
+  }
+  return found;
+}
+
+#endif
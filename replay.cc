@@ -0,0 +1,106 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
+#include "selfplay.hh"
+#include "record.hh"
+
+// Replays every game of a record file through GameEngine, a fixed
+// workload for timing State. A game that no longer fits the board, ends
+// before its last recorded move or ends with another winner means State
+// plays differently from the one that recorded it. With a chain, the
+// chain is also asked for its move before each recorded one, counting
+// how often the two agree.
+template<int N, int D>
+int replay(const string& filename, const string& chain, unsigned seed) {
+  BoardData<N, D> data;
+  ifstream ifs(filename, ios::binary);
+  if (!GameRecordFormat<N, D>::read_header(ifs)) {
+    cerr << filename << " is not a record file of " << N << "^" << D << "\n";
+    return 1;
+  }
+  vector<GameRecord> games;
+  GameRecord record;
+  while (GameRecordFormat<N, D>::read(ifs, record)) {
+    games.push_back(record);
+  }
+  default_random_engine generator(seed);
+  long long plies = 0, mismatches = 0;
+  auto start = chrono::steady_clock::now();
+  for (const auto& game : games) {
+    State<N, D> state(data);
+    GameEngine engine(generator, state, ReplayStrategy(game));
+    Mark winner = engine.play(game.start, [&](const auto& open_positions) {
+      plies++;
+    }, [](const auto& x, auto y){});
+    if (winner != game.winner || !engine.strategy.followed_record()) {
+      mismatches++;
+    }
+  }
+  double elapsed = chrono::duration<double>(
+      chrono::steady_clock::now() - start).count();
+  cout << games.size() << " games, " << plies << " plies in " << elapsed
+       << "s : " << plies / elapsed << " plies/s, " << mismatches
+       << " mismatched\n";
+  if (chain.empty()) {
+    return mismatches > 0 ? 2 : 0;
+  }
+  bool known = with_named_chain(data, chain, [&](auto make_strategy) {
+    long long agreed = 0, asked = 0;
+    for (const auto& game : games) {
+      State<N, D> state(data);
+      auto candidate = make_strategy(state, generator);
+      ReplayStrategy replayer(game);
+      GameEngine engine(generator, state, [&](
+          Mark mark, const auto& open_positions) -> optional<Position> {
+        optional<Position> mine = candidate(mark, open_positions);
+        optional<Position> recorded = replayer(mark, open_positions);
+        asked++;
+        agreed += mine == recorded;
+        return recorded;
+      });
+      engine.play(game.start);
+    }
+    cout << chain << " agrees with " << agreed << " of " << asked
+         << " recorded moves (" << 100.0 * agreed / max(asked, 1LL)
+         << "%)\n";
+  });
+  if (!known) {
+    cerr << "unknown chain " << chain << "\n";
+    return 1;
+  }
+  return mismatches > 0 ? 2 : 0;
+}
+
+// Usage: replay board records [chain] [seed]
+// Records come from "selfplay board chain games seed threads records".
+// Exits with 2 when some game did not replay as recorded.
+int main(int argc, char **argv) {
+  unsigned seed = seed_argument(argc, argv, 4);
+  if (argc < 3) {
+    cerr << "usage: replay board records [chain] [seed]\n";
+    return 1;
+  }
+  cerr << "seed " << seed << "\n";
+  string board = argv[1];
+  string records = argv[2];
+  string chain = argc > 3 && string(argv[3]) != "-" ? argv[3] : "";
+  if (board == "3x3") {
+    return replay<3, 2>(records, chain, seed);
+  } else if (board == "4x4") {
+    return replay<4, 2>(records, chain, seed);
+  } else if (board == "3x3x3") {
+    return replay<3, 3>(records, chain, seed);
+  } else if (board == "4x4x4") {
+    return replay<4, 3>(records, chain, seed);
+  } else if (board == "5x5x5") {
+    return replay<5, 3>(records, chain, seed);
+  } else if (board == "4x4x4x4") {
+    return replay<4, 4>(records, chain, seed);
+  }
+  cerr << "unknown board " << board << "\n";
+  return 1;
+}
@@ -0,0 +1,45 @@
+import json
+import sys
+
+# Tables from the search_stats.json written by minimax. The by-open table
+# compares move ordering on each side of the heatmap threshold in
+# MiniMax::get_sorted_positions: a good ordering finds its cutoffs on
+# the first child.
+
+def ratio(a, b):
+  return a / b if b else 0.0
+
+def first_share(level):
+  ranks = level["best_rank"]
+  return ratio(ranks[0] if ranks else 0, sum(ranks))
+
+def mean_rank(level):
+  ranks = level["best_rank"]
+  return ratio(sum(i * c for i, c in enumerate(ranks)), sum(ranks))
+
+def print_table(title, key, levels):
+  print(title)
+  print("%5s %10s %6s %7s %7s %7s %7s %7s %7s %8s" % (
+      key, "nodes", "branch", "cutoff", "first", "rank", "forced",
+      "chain", "tb", "heat s"))
+  for level in levels:
+    print("%5d %10d %6.2f %6.1f%% %6.1f%% %7.2f %6.1f%% %6.1f%% %6.1f%% %8.3f"
+        % (level[key], level["nodes"], level["branching"],
+           100 * ratio(level["cutoffs"], level["expanded"]),
+           100 * first_share(level), mean_rank(level),
+           100 * ratio(level["forced"], level["nodes"]),
+           100 * ratio(level["chaining_wins"], level["chaining_calls"]),
+           100 * ratio(level["tablebase_hits"], level["nodes"]),
+           level["heatmap_seconds"]))
+  print()
+
+def main():
+  filename = sys.argv[1] if len(sys.argv) > 1 else "search_stats.json"
+  with open(filename) as f:
+    stats = json.load(f)
+  print("%.3fs, heatmap %.1f%% of the time\n" % (
+      stats["seconds"], 100 * stats["heatmap_share"]))
+  print_table("By depth", "depth", stats["by_depth"])
+  print_table("By open positions", "open", stats["by_open"])
+
+main()
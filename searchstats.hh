@@ -0,0 +1,114 @@
+#ifndef SEARCHSTATS_HH
+#define SEARCHSTATS_HH
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Counts of one MiniMax run, by depth below the root (forced replies
+// included) and by number of open positions, written as JSON when the
+// search ends. reporter.py prints them as tables.
+class SearchStats {
+ public:
+  struct Level {
+    long long nodes = 0;
+    // Open positions summed over the nodes, for the branching factor.
+    long long open = 0;
+    // Nodes whose children were searched, and how many children.
+    long long expanded = 0;
+    long long children = 0;
+    // Expanded nodes that returned before their last child.
+    long long cutoffs = 0;
+    long long forced = 0;
+    long long chaining_calls = 0;
+    long long chaining_wins = 0;
+    long long tablebase_hits = 0;
+    long long heatmap_calls = 0;
+    long long heatmap_nanos = 0;
+    // Count of cutoffs caused by the child at each place of the ordering.
+    vector<long long> best_rank;
+  };
+
+  SearchStats() : start(chrono::steady_clock::now()) {
+  }
+
+  Level& at_depth(int depth) {
+    if (depth >= static_cast<int>(by_depth.size())) {
+      by_depth.resize(depth + 1);
+    }
+    return by_depth[depth];
+  }
+
+  Level& at_open(int open) {
+    return by_open[open];
+  }
+
+  // Records a node into both tables.
+  template<typename F>
+  void add(int depth, int open, F update) {
+    update(at_depth(depth));
+    update(at_open(open));
+  }
+
+  static void add_rank(Level& level, int rank) {
+    if (rank >= static_cast<int>(level.best_rank.size())) {
+      level.best_rank.resize(rank + 1);
+    }
+    level.best_rank[rank]++;
+  }
+
+  void write_json(ostream& os) const {
+    double elapsed = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+    long long heatmap_nanos = 0;
+    for (const auto& level : by_depth) {
+      heatmap_nanos += level.heatmap_nanos;
+    }
+    os << "{\n  \"seconds\": " << elapsed
+       << ",\n  \"heatmap_share\": "
+       << (elapsed > 0 ? heatmap_nanos / (elapsed * 1e9) : 0.0)
+       << ",\n  \"by_depth\": [";
+    for (int depth = 0; depth < static_cast<int>(by_depth.size()); ++depth) {
+      os << (depth == 0 ? "\n" : ",\n");
+      write_level(os, "depth", depth, by_depth[depth]);
+    }
+    os << "\n  ],\n  \"by_open\": [";
+    for (bool first = true; const auto& [open, level] : by_open) {
+      os << (first ? "\n" : ",\n");
+      write_level(os, "open", open, level);
+      first = false;
+    }
+    os << "\n  ]\n}\n";
+  }
+
+ private:
+  static void write_level(
+      ostream& os, const string& key, int index, const Level& level) {
+    os << "    {\"" << key << "\": " << index
+       << ", \"nodes\": " << level.nodes
+       << ", \"branching\": "
+       << (level.nodes > 0 ? static_cast<double>(level.open) / level.nodes : 0)
+       << ", \"expanded\": " << level.expanded
+       << ", \"children\": " << level.children
+       << ", \"cutoffs\": " << level.cutoffs
+       << ", \"forced\": " << level.forced
+       << ", \"chaining_calls\": " << level.chaining_calls
+       << ", \"chaining_wins\": " << level.chaining_wins
+       << ", \"tablebase_hits\": " << level.tablebase_hits
+       << ", \"heatmap_calls\": " << level.heatmap_calls
+       << ", \"heatmap_seconds\": " << level.heatmap_nanos * 1e-9
+       << ", \"best_rank\": [";
+    for (int i = 0; i < static_cast<int>(level.best_rank.size()); ++i) {
+      os << (i == 0 ? "" : ", ") << level.best_rank[i];
+    }
+    os << "]}";
+  }
+
+  chrono::steady_clock::time_point start;
+  vector<Level> by_depth;
+  map<int, Level> by_open;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <memory>
+#include <string>
+#include "selfplay.hh"
+
+template<int N, int D>
+int selfplay(const string& chain, long long games, unsigned seed,
+    int threads, const string& records) {
+  BoardData<N, D> data;
+  unique_ptr<ofstream> ofs;
+  if (!records.empty()) {
+    ofs = make_unique<ofstream>(records, ios::binary);
+    GameRecordFormat<N, D>::write_header(*ofs);
+  }
+  bool known = with_named_chain(data, chain, [&](auto make_strategy) {
+    SelfPlay<N, D, decltype(make_strategy)> runner(
+        data, make_strategy, seed, threads);
+    auto start = chrono::steady_clock::now();
+    auto elapsed = [&] {
+      return chrono::duration<double>(
+          chrono::steady_clock::now() - start).count();
+    };
+    auto stats = runner.run(games, chrono::seconds(1), [&](const auto& stats) {
+      cerr << elapsed() << "s: " << stats.games / elapsed() << " games/s, ";
+      stats.print_summary(cerr);
+    }, ofs.get());
+    cout << N << "^" << D << " " << chain << " on " << threads
+         << " threads, seed " << seed << " : " << stats.games / elapsed()
+         << " games/s\n";
+    stats.print_summary(cout);
+    cout << "ply\tgames\tbranching\tended\n";
+    stats.print_plies(cout);
+  });
+  if (!known) {
+    cerr << "unknown chain " << chain << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+// Usage: selfplay [board] [chain] [games] [seed] [threads] [records]
+// Board is one of 3x3, 4x4, 3x3x3, 4x4x4, 5x5x5, 4x4x4x4; chain one of
+// uniform, random, forcingmove, forcing, chaining, rollout or
+// heatmap[:trials]. Records are binary (record.hh); replay reads them.
+int main(int argc, char **argv) {
+  unsigned seed = seed_argument(argc, argv, 4);
+  string board = argc > 1 ? argv[1] : "5x5x5";
+  string chain = argc > 2 ? argv[2] : "forcing";
+  long long games = argc > 3 ? stoll(argv[3]) : 100000;
+  int threads = argc > 5 ? stoi(argv[5]) : thread::hardware_concurrency();
+  string records = argc > 6 ? argv[6] : "";
+  if (board == "3x3") {
+    return selfplay<3, 2>(chain, games, seed, threads, records);
+  } else if (board == "4x4") {
+    return selfplay<4, 2>(chain, games, seed, threads, records);
+  } else if (board == "3x3x3") {
+    return selfplay<3, 3>(chain, games, seed, threads, records);
+  } else if (board == "4x4x4") {
+    return selfplay<4, 3>(chain, games, seed, threads, records);
+  } else if (board == "5x5x5") {
+    return selfplay<5, 3>(chain, games, seed, threads, records);
+  } else if (board == "4x4x4x4") {
+    return selfplay<4, 4>(chain, games, seed, threads, records);
+  }
+  cerr << "unknown board " << board << "\n";
+  return 1;
+}
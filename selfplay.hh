@@ -0,0 +1,293 @@
+#ifndef SELFPLAY_HH
+#define SELFPLAY_HH
+
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "tictactoe.hh"
+#include "record.hh"
+
+// Totals over many games: results, game lengths, and the open positions
+// offered at each ply (summed over the games that reached it).
+template<int N, int D>
+struct SelfPlayStats {
+  constexpr static Position board_size = BoardData<N, D>::board_size;
+
+  long long games = 0;
+  // Indexed by the winning Mark, Mark::empty for draws.
+  array<long long, 3> wins = {};
+  // Games that lasted exactly i plies.
+  array<long long, board_size + 1> lengths = {};
+  array<long long, board_size + 1> reached = {};
+  array<long long, board_size + 1> branching = {};
+  array<long long, board_size + 1> branching_squares = {};
+  // Knuth's estimate of the tree size from each game, 1 + b0 + b0 b1 +
+  // ..., summed with its square. Unbiased only when moves are uniform
+  // over the open positions; other chains give a biased estimate.
+  long double knuth = 0.0, knuth_squares = 0.0;
+
+  SelfPlayStats& operator+=(const SelfPlayStats& other) {
+    games += other.games;
+    for (int i = 0; i < 3; ++i) {
+      wins[i] += other.wins[i];
+    }
+    for (int i = 0; i <= board_size; ++i) {
+      lengths[i] += other.lengths[i];
+      reached[i] += other.reached[i];
+      branching[i] += other.branching[i];
+      branching_squares[i] += other.branching_squares[i];
+    }
+    knuth += other.knuth;
+    knuth_squares += other.knuth_squares;
+    return *this;
+  }
+
+  double rate(Mark mark) const {
+    return games == 0 ? 0.0 :
+        static_cast<double>(wins[static_cast<int>(mark)]) / games;
+  }
+
+  double mean_length() const {
+    long long plies = 0;
+    for (int i = 0; i <= board_size; ++i) {
+      plies += i * lengths[i];
+    }
+    return games == 0 ? 0.0 : static_cast<double>(plies) / games;
+  }
+
+  double mean_branching(int ply) const {
+    return static_cast<double>(branching[ply]) / reached[ply];
+  }
+
+  // Half width of the 95% confidence interval of mean_branching.
+  double branching_error(int ply) const {
+    return error<double>(
+        reached[ply], branching[ply], branching_squares[ply]);
+  }
+
+  long double knuth_mean() const {
+    return knuth / games;
+  }
+
+  long double knuth_error() const {
+    return error(games, knuth, knuth_squares);
+  }
+
+  void print_summary(ostream& os) const {
+    os << games << " games, X " << rate(Mark::X) << " O " << rate(Mark::O)
+       << " draw " << rate(Mark::empty) << ", mean length "
+       << mean_length() << "\n";
+  }
+
+  // One line per ply: games reaching it, mean branching, games ending.
+  void print_plies(ostream& os) const {
+    for (int i = 0; i <= board_size && reached[i] > 0; ++i) {
+      os << i << "\t" << reached[i] << "\t" << mean_branching(i) << "\t"
+         << lengths[i] << "\n";
+    }
+  }
+
+ private:
+  template<typename T>
+  static T error(long long samples, T sum, T squares) {
+    if (samples < 2) {
+      return numeric_limits<T>::infinity();
+    }
+    T mean = sum / samples;
+    T variance = max(T(0), (squares - sum * mean) / (samples - 1));
+    return 1.96 * sqrt(variance / samples);
+  }
+};
+
+// Calls run(make_strategy) with the named chain: uniform, random,
+// forcingmove, forcing, chaining, rollout or heatmap[:trials]. Returns
+// false for an unknown name.
+template<int N, int D>
+bool with_named_chain(const BoardData<N, D>& data, string chain, auto run) {
+  int trials = 25;
+  if (auto colon = chain.find(':'); colon != string::npos) {
+    trials = stoi(chain.substr(colon + 1));
+    chain = chain.substr(0, colon);
+  }
+  if (chain == "uniform") {
+    run([&](const auto& state, auto& generator) {
+      return UniformRandom<N, D>(generator);
+    });
+  } else if (chain == "random") {
+    run([&](const auto& state, auto& generator) {
+      return BiasedRandom(state, generator);
+    });
+  } else if (chain == "forcingmove") {
+    run([&](const auto& state, auto& generator) {
+      return ForcingMove(state) >> BiasedRandom(state, generator);
+    });
+  } else if (chain == "forcing") {
+    run([&](const auto& state, auto& generator) {
+      return
+          ForcingMove(state) >>
+          ForcingStrategy(state, data) >>
+          BiasedRandom(state, generator);
+    });
+  } else if (chain == "chaining") {
+    run([&](const auto& state, auto& generator) {
+      return
+          ForcingMove(state) >>
+          ChainingStrategy(state) >>
+          BiasedRandom(state, generator);
+    });
+  } else if (chain == "rollout") {
+    run([&](const auto& state, auto& generator) {
+      return RolloutPolicy(state, generator);
+    });
+  } else if constexpr (D <= 3) {
+    if (chain != "heatmap") {
+      return false;
+    }
+    // HeatMap prints boards of two and three dimensions only.
+    run([&, trials](const auto& state, auto& generator) {
+      return
+          ForcingMove(state) >>
+          ForcingStrategy(state, data) >>
+          HeatMap(state, data, generator, trials);
+    });
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Plays games of make_strategy(state, generator) against itself on every
+// core. Each worker owns its States and a generator seeded from (seed,
+// worker), and folds its counts into the shared totals once per batch of
+// games, so the game loop itself touches no shared data.
+template<int N, int D, typename F>
+class SelfPlay {
+ public:
+  SelfPlay(const BoardData<N, D>& data, F make_strategy, unsigned seed,
+      int threads = thread::hardware_concurrency())
+      : data(data), make_strategy(make_strategy), seed(seed),
+        threads(max(threads, 1)) {
+  }
+
+  // Games between reports folded in by each worker.
+  constexpr static int batch_size = 256;
+
+  // Plays the games, calling report(totals) from this thread every
+  // interval until done. Records, when given, get every game in the
+  // format of record.hh (the caller writes the header); games of
+  // different workers interleave in batches.
+  template<typename R>
+  SelfPlayStats<N, D> run(long long games, chrono::milliseconds interval,
+      R report, ostream *records = nullptr) {
+    return run_until(games, interval, report,
+        [](const auto& x) { return false; }, records);
+  }
+
+  // As run, but stops once stop(totals) holds after a report; workers
+  // notice at their next batch.
+  template<typename R, typename P>
+  SelfPlayStats<N, D> run_until(long long games,
+      chrono::milliseconds interval, R report, P stop,
+      ostream *records = nullptr) {
+    total = SelfPlayStats<N, D>();
+    finished = 0;
+    stopping = false;
+    vector<thread> workers;
+    for (int worker = 0; worker < threads; ++worker) {
+      // Splits without games * worker, which overflows for a run bounded
+      // only by stop.
+      long long share = games / threads + (worker < games % threads);
+      workers.emplace_back([=, this] {
+        play(worker, share, records);
+      });
+    }
+    unique_lock<mutex> guard(lock);
+    while (finished < threads) {
+      if (!done.wait_for(guard, interval, [&] {
+            return finished == threads; })) {
+        report(total);
+        if (stop(total)) {
+          stopping = true;
+        }
+      }
+    }
+    guard.unlock();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    return total;
+  }
+
+ private:
+  void play(int worker, long long games, ostream *records) {
+    seed_seq sequence{seed, static_cast<unsigned>(worker)};
+    default_random_engine generator(sequence);
+    SelfPlayStats<N, D> local;
+    ostringstream buffer;
+    GameRecord record;
+    for (long long i = 0; i < games && !stopping; ++i) {
+      State<N, D> state(data);
+      GameEngine engine(generator, state, make_strategy(state, generator));
+      int ply = 0;
+      long double width = 1.0, nodes = 1.0;
+      record.moves.clear();
+      Mark winner = engine.play(Mark::X, [&](const auto& open_positions) {
+        long long count = open_positions.count();
+        local.reached[ply] += 1;
+        local.branching[ply] += count;
+        local.branching_squares[ply] += count * count;
+        width *= count;
+        nodes += width;
+        ply++;
+      }, [&](const auto& state, auto pos) {
+        if (records != nullptr) {
+          record.moves.push_back(pos);
+        }
+      });
+      local.games++;
+      local.wins[static_cast<int>(winner)]++;
+      local.lengths[ply]++;
+      local.knuth += nodes;
+      local.knuth_squares += nodes * nodes;
+      if (records != nullptr) {
+        record.winner = winner;
+        GameRecordFormat<N, D>::write(buffer, record);
+      }
+      if (local.games == batch_size) {
+        lock_guard<mutex> guard(lock);
+        fold(local, buffer, records);
+      }
+    }
+    lock_guard<mutex> guard(lock);
+    fold(local, buffer, records);
+    finished++;
+    done.notify_one();
+  }
+
+  // Caller holds the lock.
+  void fold(SelfPlayStats<N, D>& local, ostringstream& buffer,
+      ostream *records) {
+    total += local;
+    local = SelfPlayStats<N, D>();
+    if (records != nullptr) {
+      *records << buffer.str();
+      buffer.str("");
+    }
+  }
+
+  const BoardData<N, D>& data;
+  F make_strategy;
+  unsigned seed;
+  int threads;
+  mutex lock;
+  condition_variable done;
+  int finished;
+  atomic<bool> stopping;
+  SelfPlayStats<N, D> total;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.hh"
+
+// Reads one node of a SolutionTree dump and its subtree, recording the
+// node with the first child that keeps its value. Values below an
+// alpha-beta cutoff may be bounds; tablebases are exact.
+template<int N, int D>
+int convert_node(istream& ifs, BookBuilder<N, D>& builder,
+    const State<N, D>& state, Mark mark) {
+  int value, count, size;
+  char colon;
+  ifs >> value >> count >> size >> colon;
+  vector<int> children(size);
+  for (auto& child : children) {
+    ifs >> child;
+  }
+  optional<Position> best;
+  for (int child : children) {
+    State<N, D> cloned(state);
+    cloned.play(Position{child}, mark);
+    int child_value = convert_node(ifs, builder, cloned, flip(mark));
+    if (!best.has_value() && child_value == value) {
+      best = Position{child};
+    }
+  }
+  builder.insert(state, mark, best, value);
+  return value;
+}
+
+template<int N, int D>
+void convert(istream& ifs, const string& output) {
+  BoardData<N, D> data;
+  BookBuilder<N, D> builder(data);
+  convert_node(ifs, builder, State<N, D>(data), Mark::X);
+  builder.write(output);
+  cout << builder.size() << " positions written to " << output << "\n";
+}
+
+int convert(const string& input, const string& output) {
+  ifstream ifs(input);
+  int n, d;
+  ifs >> n >> d;
+  if (n == 3 && d == 2) {
+    convert<3, 2>(ifs, output);
+  } else if (n == 4 && d == 2) {
+    convert<4, 2>(ifs, output);
+  } else if (n == 3 && d == 3) {
+    convert<3, 3>(ifs, output);
+  } else {
+    cout << "unsupported board " << n << "^" << d << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+// Newline-terminated requests; every complete line of a read is answered
+// in one write, so a client batches by sending many lines at once.
+int serve(const string& path, const vector<string>& filenames) {
+  MoveService service(filenames);
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  unlink(path.c_str());
+  if (bind(listener, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) < 0 || listen(listener, 16) < 0) {
+    perror("server");
+    return 1;
+  }
+  cout << "listening on " << path << endl;
+  vector<pollfd> fds{{listener, POLLIN, 0}};
+  vector<string> pending{""};
+  char buffer[1 << 16];
+  while (true) {
+    poll(fds.data(), fds.size(), -1);
+    if (fds[0].revents & POLLIN) {
+      int client = accept(listener, nullptr, nullptr);
+      if (client >= 0) {
+        fds.push_back({client, POLLIN, 0});
+        pending.emplace_back();
+      }
+    }
+    for (int i = static_cast<int>(fds.size()) - 1; i > 0; --i) {
+      if (!(fds[i].revents & (POLLIN | POLLHUP))) {
+        continue;
+      }
+      ssize_t size = read(fds[i].fd, buffer, sizeof(buffer));
+      if (size <= 0) {
+        close(fds[i].fd);
+        fds.erase(begin(fds) + i);
+        pending.erase(begin(pending) + i);
+        continue;
+      }
+      pending[i].append(buffer, size);
+      string replies;
+      size_t start = 0;
+      for (size_t end; (end = pending[i].find('\n', start)) != string::npos;
+           start = end + 1) {
+        replies += service.handle(pending[i].substr(start, end - start));
+        replies += '\n';
+      }
+      pending[i].erase(0, start);
+      if (!replies.empty() &&
+          write(fds[i].fd, replies.data(), replies.size()) < 0) {
+        perror("server");
+      }
+    }
+  }
+}
+
+// Usage:
+//   server <socket> <book or tablebase>...
+//   server --convert <solution.txt> <output.book>
+int main(int argc, char **argv) {
+  if (argc == 4 && string(argv[1]) == "--convert") {
+    return convert(argv[2], argv[3]);
+  }
+  if (argc < 3) {
+    cout << "usage: server <socket> <book or tablebase>...\n"
+         << "       server --convert <solution.txt> <output.book>\n";
+    return 1;
+  }
+  return serve(argv[1], vector<string>(argv + 2, argv + argc));
+}
@@ -0,0 +1,185 @@
+#ifndef SERVER_HH
+#define SERVER_HH
+
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include "tictactoe.hh"
+#include "book.hh"
+
+// Latencies of the most recent requests, for percentile reports.
+class LatencyCounter {
+ public:
+  explicit LatencyCounter(int window = 1 << 16) : window(window), total(0) {
+  }
+
+  void add(long long nanos) {
+    if (static_cast<int>(samples.size()) < window) {
+      samples.push_back(nanos);
+    } else {
+      samples[total % window] = nanos;
+    }
+    total++;
+  }
+
+  long long count() const {
+    return total;
+  }
+
+  // O(window).
+  long long percentile(double p) const {
+    if (samples.empty()) {
+      return 0;
+    }
+    vector<long long> sorted(samples);
+    auto nth = begin(sorted) + static_cast<int>(p * (sorted.size() - 1));
+    nth_element(begin(sorted), nth, end(sorted));
+    return *nth;
+  }
+
+ private:
+  const int window;
+  long long total;
+  vector<long long> samples;
+};
+
+// Answers for one board shape from a tablebase, which is exact, or else
+// from a book converted from a MiniMax solution tree.
+template<int N, int D>
+class BoardService {
+ public:
+  explicit BoardService(const string& filename)
+      : book(data, filename), tablebase(data, filename) {
+  }
+
+  constexpr static Position board_size = BoardData<N, D>::board_size;
+
+  bool loaded() const {
+    return book.size() > 0 || tablebase.get_max_empty() >= 0;
+  }
+
+  // Board as a string of '.', 'X' and 'O'; the side to move follows from
+  // the mark counts. Replies "<move> <value>", with -1 for no move and
+  // X, O, D or ? for the value, or "error <reason>" for a board no game
+  // reaches or one that is already over.
+  string answer(const string& board) const {
+    int balance = 0, empty = 0;
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      if (board[pos] == 'X' || board[pos] == 'O') {
+        balance += board[pos] == 'X' ? 1 : -1;
+      } else if (board[pos] == '.') {
+        empty++;
+      } else {
+        return "error bad cell";
+      }
+    }
+    if (balance != 0 && balance != 1) {
+      return "error bad mark count";
+    }
+    // Cells go down in index order, so some may be dead by their turn.
+    State<N, D> state(data);
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      if (board[pos] != '.' &&
+          state.place(pos, board[pos] == 'X' ? Mark::X : Mark::O)) {
+        return "error game over";
+      }
+    }
+    if (empty == 0) {
+      return "error game over";
+    }
+    Mark mark = balance == 0 ? Mark::X : Mark::O;
+    optional<Position> move;
+    optional<BoardValue> value = tablebase.probe(state, mark);
+    if (value.has_value()) {
+      move = TablebaseStrategy(state, tablebase)(
+          mark, state.get_open_positions(mark));
+    } else if (auto entry = book.lookup(state, mark); entry.has_value()) {
+      move = entry->first;
+      value = static_cast<BoardValue>(entry->second);
+    }
+    ostringstream reply;
+    reply << (move.has_value() ? static_cast<int>(*move) : -1) << " "
+          << encode(value);
+    return reply.str();
+  }
+
+ private:
+  static char encode(optional<BoardValue> value) {
+    if (!value.has_value()) {
+      return '?';
+    }
+    return *value == BoardValue::X_WIN ? 'X'
+         : *value == BoardValue::O_WIN ? 'O'
+         : *value == BoardValue::DRAW ? 'D'
+         : '?';
+  }
+
+  BoardData<N, D> data;
+  OpeningBook<N, D> book;
+  Tablebase<N, D> tablebase;
+};
+
+// Line protocol of the move server. A request is a board string, whose
+// length picks the board, or "stats".
+class MoveService {
+ public:
+  // Each file is loaded as whichever book or tablebase it validates as.
+  explicit MoveService(const vector<string>& filenames) {
+    for (const auto& filename : filenames) {
+      bool loaded =
+          add<3, 2>(filename) || add<4, 2>(filename) ||
+          add<3, 3>(filename) || add<4, 3>(filename);
+      cout << filename << (loaded ? " loaded\n" : " not recognized\n");
+    }
+  }
+
+  string handle(const string& request) {
+    if (request == "stats") {
+      ostringstream reply;
+      reply << "requests " << latency.count()
+            << " p50 " << latency.percentile(0.50) << "ns"
+            << " p99 " << latency.percentile(0.99) << "ns";
+      return reply.str();
+    }
+    auto start = chrono::steady_clock::now();
+    auto it = boards.find(request.size());
+    string reply = it == boards.end() ? "error unknown board" :
+        it->second(request);
+    auto end = chrono::steady_clock::now();
+    latency.add(chrono::duration_cast<chrono::nanoseconds>(
+        end - start).count());
+    return reply;
+  }
+
+  const LatencyCounter& get_latency() const {
+    return latency;
+  }
+
+ private:
+  template<int N, int D>
+  bool add(const string& filename) {
+    auto service = make_shared<BoardService<N, D>>(filename);
+    if (!service->loaded()) {
+      return false;
+    }
+    auto& slot = boards[BoardData<N, D>::board_size];
+    auto previous = slot;
+    // The last file loaded for a board answers first; earlier ones fill
+    // in the positions it does not know.
+    slot = [service, previous](const string& board) {
+      string reply = service->answer(board);
+      if (previous && reply.ends_with("?")) {
+        return previous(board);
+      }
+      return reply;
+    };
+    return true;
+  }
+
+  unordered_map<size_t, function<string(const string&)>> boards;
+  LatencyCounter latency;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <variant>
 #include <fstream>
 #include "boarddata.hh"
+#include "trace.hh"
 
 class SolutionTree {
  public:
@@ -16,6 +17,11 @@ class SolutionTree {
     Node *get_last_child() const {
       return children.rbegin()->second.get();
     }
+    Node *add_child(Position pos) {
+      MEMORY_SCOPE(solution_tree);
+      children.emplace_back(pos, make_unique<Node>());
+      return get_last_child();
+    }
   };
   SolutionTree() : root(make_unique<Node>()) {
   }
@@ -24,6 +30,7 @@ class SolutionTree {
   }
   template<int N, int D>
   void dump(const BoardData<N, D>& data, string filename) const {
+    TRACE_SCOPE("dump");
     ofstream ofs(filename);
     ofs << N << " " << D << "\n";
     dump_node(ofs, root.get());
@@ -12,10 +12,12 @@
 #include <bitset>
 #include <execution>
 #include <list>
+#include <limits>
 #include "semantic.hh"
 #include "boarddata.hh"
 #include "tracking.hh"
 #include "elevator.hh"
+#include "fenwick.hh"
 
 template<int N, int D>
 class State {
@@ -25,7 +27,12 @@ class State {
       board(Mark::empty),
       xor_table(data.xor_table()),
       current_accumulation(data.accumulation_points()),
-      trie_node(0_node) {
+      trie_node(0_node),
+      empty_count(board_size),
+      weights(data.accumulation_points()),
+      hash(0),
+      win_lines{ThreatCount(0), ThreatCount(0)},
+      threat_lines{ThreatCount(0), ThreatCount(0)} {
   }
 
   constexpr static Position board_size = BoardData<N, D>::board_size;
@@ -87,27 +94,19 @@ class State {
   }
 
   bool play(Position pos, Mark mark) {
-    board[pos] = mark;
     empty_cells.remove(pos);
-    trie_node = data.next(trie_node, pos);
-    for (Line line : data.lines_through_position()[pos]) {
-      xor_table[line] ^= pos;
-      Mark old_mark = line_marks.get_mark(line);
-      MarkCount count = (line_marks[line] += mark);
-      Mark new_mark = line_marks.get_mark(line);
-      if (count == N && new_mark != Mark::both) {
-        return true;
-      }
-      if (old_mark != new_mark && new_mark == Mark::both) {
-        for (Position neigh : data.winning_lines()[line]) {
-          current_accumulation[neigh]--;
-          if (current_accumulation[neigh] == 0 && empty_cells.check(neigh)) {
-            empty_cells.remove(neigh);
-          }
-        }
-      }
+    empty_count--;
+    return mark_cell(pos, mark);
+  }
+
+  // Like play, but pos may already be dead, as happens when a board is
+  // set up one cell at a time in an order no game followed.
+  bool place(Position pos, Mark mark) {
+    if (empty_cells.check(pos)) {
+      empty_cells.remove(pos);
+      empty_count--;
     }
-    return false;
+    return mark_cell(pos, mark);
   }
 
   auto get_line_marks(MarkCount count, Mark mark) const {
@@ -122,6 +121,38 @@ class State {
     return current_accumulation[pos];
   };
 
+  // Number of cells still in empty_cells, i.e. not played and not dead.
+  int get_empty_count() const {
+    return empty_count;
+  }
+
+  // Sum of current_accumulation over all unplayed cells.
+  int get_total_weight() const {
+    return weights.total();
+  }
+
+  // Samples an unplayed cell with probability proportional to its
+  // current_accumulation, in O(log n).
+  Position find_weight(int value) const {
+    return weights.find(value);
+  }
+
+  // Empty cells that complete a line of mark. O(1).
+  const Bitfield<N, D>& get_winning_cells(Mark mark) const {
+    return winning_cells[mark == Mark::X ? 0 : 1];
+  }
+
+  // Cells crossed by at least two lines holding N-2 of mark and nothing
+  // else; playing an empty one makes a double threat. O(1).
+  const Bitfield<N, D>& get_double_threats(Mark mark) const {
+    return double_threats[mark == Mark::X ? 0 : 1];
+  }
+
+  // Zobrist hash of the marks on the board, O(1) per play.
+  uint64_t get_hash() const {
+    return hash;
+  }
+
   Mark get_board(Position pos) const {
     return board[pos];
   }
@@ -158,6 +189,81 @@ class State {
   NodeLine trie_node;
   TrackingList<N, D> empty_cells;
   Elevator<N, D> line_marks;
+  int empty_count;
+  FenwickTree<N, D> weights;
+  uint64_t hash;
+  using ThreatCount = sarray<Position, int8_t, board_size>;
+  array<ThreatCount, 2> win_lines;
+  array<Bitfield<N, D>, 2> winning_cells;
+  array<ThreatCount, 2> threat_lines;
+  array<Bitfield<N, D>, 2> double_threats;
+
+  // Everything play does but taking pos off empty_cells.
+  bool mark_cell(Position pos, Mark mark) {
+    board[pos] = mark;
+    hash ^= data.zobrist()[pos][mark == Mark::X ? 0 : 1];
+    weights.add(pos, -current_accumulation[pos]);
+    trie_node = data.next(trie_node, pos);
+    for (Line line : data.lines_through_position()[pos]) {
+      xor_table[line] ^= pos;
+      Mark old_mark = line_marks.get_mark(line);
+      MarkCount count = (line_marks[line] += mark);
+      Mark new_mark = line_marks.get_mark(line);
+      track_wins(line, MarkCount{count - 1}, old_mark, pos, -1);
+      track_wins(line, count, new_mark, xor_table[line], 1);
+      track_threats(line, MarkCount{count - 1}, old_mark, -1);
+      track_threats(line, count, new_mark, 1);
+      if (count == N && new_mark != Mark::both) {
+        return true;
+      }
+      if (old_mark != new_mark && new_mark == Mark::both) {
+        for (Position neigh : data.winning_lines()[line]) {
+          current_accumulation[neigh]--;
+          if (board[neigh] == Mark::empty) {
+            weights.add(neigh, -1);
+          }
+          if (current_accumulation[neigh] == 0 && empty_cells.check(neigh)) {
+            empty_cells.remove(neigh);
+            empty_count--;
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+  // O(1) when the line enters or leaves the N-1 floor of a single mark;
+  // cell is the one empty position left on the line.
+  void track_wins(
+      Line line, MarkCount count, Mark mark, Position cell, int delta) {
+    if (count != N - 1 || (mark != Mark::X && mark != Mark::O)) {
+      return;
+    }
+    auto& lines = win_lines[mark == Mark::X ? 0 : 1];
+    lines[cell] += delta;
+    if (lines[cell] > 0) {
+      winning_cells[mark == Mark::X ? 0 : 1].set(cell);
+    } else {
+      winning_cells[mark == Mark::X ? 0 : 1].reset(cell);
+    }
+  }
+
+  // O(N) when the line enters or leaves the N-2 floor of a single mark.
+  void track_threats(Line line, MarkCount count, Mark mark, int delta) {
+    if (count != N - 2 || (mark != Mark::X && mark != Mark::O)) {
+      return;
+    }
+    auto& lines = threat_lines[mark == Mark::X ? 0 : 1];
+    auto& cells = double_threats[mark == Mark::X ? 0 : 1];
+    for (Position pos : data.winning_lines()[line]) {
+      lines[pos] += delta;
+      if (lines[pos] >= 2) {
+        cells.set(pos);
+      } else {
+        cells.reset(pos);
+      }
+    }
+  }
 
   char encode_position(Mark pos) const {
     return pos == Mark::X ? 'X'
@@ -166,4 +272,33 @@ class State {
   }
 };
 
+// Smallest Zobrist hash over all symmetric images of the board, and the
+// symmetry that reaches it. O(symmetries * marks).
+template<int N, int D>
+pair<uint64_t, SymLine> canonical_hash(
+    const BoardData<N, D>& data, const State<N, D>& state, Mark mark) {
+  constexpr Position board_size = BoardData<N, D>::board_size;
+  vector<pair<Position, int>> marks;
+  for (Position pos = 0_pos; pos < board_size; ++pos) {
+    Mark cell = state.get_board(pos);
+    if (cell != Mark::empty) {
+      marks.emplace_back(pos, cell == Mark::X ? 0 : 1);
+    }
+  }
+  const auto& symmetries = data.symmetries();
+  uint64_t best = numeric_limits<uint64_t>::max();
+  SymLine chosen = 0_sym;
+  for (SymLine s = 0_sym; s < static_cast<int>(symmetries.size()); ++s) {
+    uint64_t hash = mark == Mark::O ? 0x9e3779b97f4a7c15ull : 0;
+    for (const auto& [pos, side] : marks) {
+      hash ^= data.zobrist()[symmetries[s][pos]][side];
+    }
+    if (hash < best) {
+      best = hash;
+      chosen = s;
+    }
+  }
+  return make_pair(best, chosen);
+}
+
 #endif
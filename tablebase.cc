@@ -0,0 +1,54 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
+#include "tictactoe.hh"
+#include "tablebase.hh"
+
+template<int N, int D>
+void full(int max_empty, string filename) {
+  BoardData<N, D> data;
+  TablebaseBuilder<N, D> builder(data, max_empty);
+  auto start = chrono::steady_clock::now();
+  BoardValue value = builder.build_full();
+  auto end = chrono::steady_clock::now();
+  builder.write(filename);
+  cout << N << "^" << D << " value " << static_cast<int>(value)
+       << " : " << builder.size() << " positions, "
+       << builder.get_visited() << " nodes in "
+       << chrono::duration<double>(end - start).count() << "s -> "
+       << filename << "\n";
+}
+
+template<int N, int D>
+void sampled(int max_empty, int games, unsigned seed, string filename) {
+  BoardData<N, D> data;
+  default_random_engine generator(seed);
+  TablebaseBuilder<N, D> builder(data, max_empty);
+  auto start = chrono::steady_clock::now();
+  builder.build_sampled(games, [&](const auto& state) {
+    return RolloutPolicy<N, D>(state, generator);
+  });
+  auto end = chrono::steady_clock::now();
+  builder.write(filename);
+  cout << N << "^" << D << " sampled : " << builder.size() << " positions, "
+       << builder.get_visited() << " nodes in "
+       << chrono::duration<double>(end - start).count() << "s -> "
+       << filename << "\n";
+}
+
+// Usage: tablebase [live cells] [games] [seed]
+// Full tables for 4x4 and 3x3x3, and a partial one for 4x4x4 below the
+// positions reached by RolloutPolicy games.
+int main(int argc, char **argv) {
+  unsigned seed = seed_argument(argc, argv, 3);
+  cerr << "seed " << seed << "\n";
+  int max_empty = argc > 1 ? stoi(argv[1]) : 12;
+  int games = argc > 2 ? stoi(argv[2]) : 1000;
+  full<4, 2>(16, "4x4.tb");
+  full<3, 3>(27, "3x3x3.tb");
+  sampled<4, 3>(max_empty, games, seed, "4x4x4.tb");
+  return 0;
+}
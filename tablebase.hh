@@ -0,0 +1,326 @@
+#ifndef TABLEBASE_HH
+#define TABLEBASE_HH
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "boarddata.hh"
+#include "state.hh"
+
+// On-disk layout: a TablebaseHeader followed by an open-addressing table
+// of slots. A slot keeps the upper bits of the canonical hash and the
+// BoardValue in its two low bits; empty slots are all ones.
+struct TablebaseHeader {
+  char magic[8];
+  int32_t n, d;
+  // Largest number of live empty cells of a stored position.
+  int32_t max_empty;
+  int32_t reserved;
+  uint64_t slots;
+};
+
+constexpr char tablebase_magic[8] = {'N', 'D', 'T', 'T', 'T', 'T', 'B', '1'};
+constexpr uint64_t tablebase_empty_slot = numeric_limits<uint64_t>::max();
+
+// Positions where the side to move has a win, faces two wins, or must
+// block a single one are decided by these rules alone and not stored.
+// The first holds the answer, the second is the forced block.
+template<int N, int D>
+pair<optional<BoardValue>, optional<Position>> decide_forced(
+    const State<N, D>& state, Mark mark) {
+  auto winner = [](Mark mark) {
+    return mark == Mark::X ? BoardValue::X_WIN : BoardValue::O_WIN;
+  };
+  if (!state.get_winning_cells(mark).none()) {
+    return {winner(mark), {}};
+  }
+  const auto& threats = state.get_winning_cells(flip(mark));
+  if (threats.count() >= 2) {
+    return {winner(flip(mark)), {}};
+  }
+  if (threats.count() == 1) {
+    return {{}, threats.first()};
+  }
+  return {};
+}
+
+// Read-only tablebase mapped from disk. A missing or malformed file
+// gives an empty table.
+template<int N, int D>
+class Tablebase {
+ public:
+  Tablebase(const BoardData<N, D>& data, const string& filename)
+      : data(data), mapped(nullptr), length(0), table(nullptr), slots(0),
+        max_empty(-1) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 &&
+        info.st_size >= static_cast<off_t>(sizeof(TablebaseHeader))) {
+      length = info.st_size;
+      mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+        mapped = nullptr;
+      }
+    }
+    ::close(fd);
+    if (mapped == nullptr) {
+      return;
+    }
+    const auto *header = static_cast<const TablebaseHeader*>(mapped);
+    if (memcmp(header->magic, tablebase_magic, sizeof(tablebase_magic)) != 0 ||
+        header->n != N || header->d != D ||
+        length != sizeof(TablebaseHeader) + header->slots * sizeof(uint64_t)) {
+      return;
+    }
+    table = reinterpret_cast<const uint64_t*>(header + 1);
+    slots = header->slots;
+    max_empty = header->max_empty;
+  }
+
+  Tablebase(const Tablebase&) = delete;
+  Tablebase& operator=(const Tablebase&) = delete;
+
+  ~Tablebase() {
+    if (mapped != nullptr) {
+      munmap(mapped, length);
+    }
+  }
+
+  int get_max_empty() const {
+    return max_empty;
+  }
+
+  // Value of the position with mark to move, when the forced-move rules
+  // or the table know it. Positions above the table's range have none.
+  // Expected O(1) probes after the canonical hash.
+  optional<BoardValue> probe(const State<N, D>& state, Mark mark) const {
+    if (slots == 0 || state.get_empty_count() > max_empty) {
+      return {};
+    }
+    auto [value, block] = decide_forced(state, mark);
+    if (value.has_value()) {
+      return value;
+    }
+    if (block.has_value()) {
+      State<N, D> cloned(state);
+      cloned.play(*block, mark);
+      return probe(cloned, flip(mark));
+    }
+    if (state.get_empty_count() == 0) {
+      return BoardValue::DRAW;
+    }
+    return find(canonical_hash(data, state, mark).first);
+  }
+
+  optional<BoardValue> find(uint64_t key) const {
+    for (uint64_t i = (key >> 2) & (slots - 1);; i = (i + 1) & (slots - 1)) {
+      if (table[i] == tablebase_empty_slot) {
+        return {};
+      }
+      if ((table[i] | 3) == (key | 3)) {
+        return static_cast<BoardValue>(table[i] & 3);
+      }
+    }
+  }
+
+ private:
+  const BoardData<N, D>& data;
+  void *mapped;
+  size_t length;
+  const uint64_t *table;
+  uint64_t slots;
+  int max_empty;
+};
+
+// Solves every position below a root with a transposition table over
+// canonical hashes; the ones with at most max_empty live empty cells go
+// to the tablebase. Since children are solved before their parent, the
+// table fills from the end of the game backwards.
+template<int N, int D>
+class TablebaseBuilder {
+ public:
+  TablebaseBuilder(const BoardData<N, D>& data, int max_empty)
+      : data(data), max_empty(max_empty), visited(0) {
+  }
+
+  // Every position reachable from the empty board.
+  BoardValue build_full() {
+    return solve(State<N, D>(data), Mark::X);
+  }
+
+  // Games played by make_strategy(state) until at most max_empty live
+  // cells remain, and every position below the one reached.
+  template<typename F>
+  void build_sampled(int games, F make_strategy) {
+    for (int i = 0; i < games; ++i) {
+      State<N, D> state(data);
+      auto strategy = make_strategy(state);
+      Mark mark = Mark::X;
+      bool finished = false;
+      while (!finished && state.get_empty_count() > max_empty) {
+        auto open_positions = state.get_open_positions(mark);
+        if (open_positions.none()) {
+          finished = true;
+          break;
+        }
+        auto pos = strategy(mark, open_positions);
+        finished = pos.has_value() && state.play(*pos, mark);
+        mark = flip(mark);
+      }
+      if (!finished) {
+        solve(state, mark);
+      }
+    }
+  }
+
+  int size() const {
+    return accumulate(begin(memo), end(memo), 0, [](int a, const auto& entry) {
+      return a + stored(entry.second);
+    });
+  }
+
+  long long get_visited() const {
+    return visited;
+  }
+
+  void write(const string& filename) const {
+    uint64_t slots = 1;
+    while (slots < 2 * static_cast<uint64_t>(size())) {
+      slots *= 2;
+    }
+    vector<uint64_t> table(slots, tablebase_empty_slot);
+    for (const auto& [key, entry] : memo) {
+      if (!stored(entry)) {
+        continue;
+      }
+      uint64_t i = (key >> 2) & (slots - 1);
+      while (table[i] != tablebase_empty_slot) {
+        i = (i + 1) & (slots - 1);
+      }
+      table[i] = (key & ~3ull) | static_cast<uint64_t>(value(entry));
+    }
+    ofstream ofs(filename, ios::binary);
+    TablebaseHeader header;
+    memcpy(header.magic, tablebase_magic, sizeof(tablebase_magic));
+    header.n = N;
+    header.d = D;
+    header.max_empty = max_empty;
+    header.reserved = 0;
+    header.slots = slots;
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(table.data()),
+              slots * sizeof(uint64_t));
+  }
+
+ private:
+  // Low bits hold the BoardValue; bit 2 marks entries for the table.
+  static bool stored(uint8_t entry) {
+    return entry & 4;
+  }
+
+  static BoardValue value(uint8_t entry) {
+    return static_cast<BoardValue>(entry & 3);
+  }
+
+  static BoardValue winner(Mark mark) {
+    return mark == Mark::X ? BoardValue::X_WIN : BoardValue::O_WIN;
+  }
+
+  BoardValue solve(const State<N, D>& state, Mark mark) {
+    visited++;
+    auto [decided, block] = decide_forced(state, mark);
+    if (decided.has_value()) {
+      return *decided;
+    }
+    if (block.has_value()) {
+      State<N, D> cloned(state);
+      cloned.play(*block, mark);
+      return solve(cloned, flip(mark));
+    }
+    auto open_positions = state.get_open_positions(mark);
+    if (open_positions.none()) {
+      return BoardValue::DRAW;
+    }
+    uint64_t key = canonical_hash(data, state, mark).first;
+    if (auto it = memo.find(key); it != memo.end()) {
+      return value(it->second);
+    }
+    BoardValue best = winner(flip(mark));
+    for (Position pos : open_positions.all()) {
+      State<N, D> cloned(state);
+      cloned.play(pos, mark);
+      // No cutoff: every child is a position the table should hold.
+      BoardValue result = solve(cloned, flip(mark));
+      if (result == winner(mark)) {
+        best = result;
+      } else if (result == BoardValue::DRAW && best != winner(mark)) {
+        best = result;
+      }
+    }
+    memo[key] = static_cast<uint8_t>(best) |
+                (state.get_empty_count() <= max_empty ? 4 : 0);
+    return best;
+  }
+
+  const BoardData<N, D>& data;
+  int max_empty;
+  long long visited;
+  unordered_map<uint64_t, uint8_t> memo;
+};
+
+// Plays a move that keeps the best tablebase value, for positions the
+// table covers; otherwise falls through to the rest of the chain.
+template<int N, int D>
+class TablebaseStrategy {
+ public:
+  TablebaseStrategy(const State<N, D>& state, const Tablebase<N, D>& tablebase)
+      : state(state), tablebase(tablebase) {
+  }
+  const State<N, D>& state;
+  const Tablebase<N, D>& tablebase;
+
+  template<typename B>
+  optional<Position> operator()(Mark mark, const B& open_positions) {
+    optional<Position> best;
+    if (state.get_empty_count() > tablebase.get_max_empty()) {
+      return best;
+    }
+    // The table skips positions where a side passed up its own win, so
+    // such a win is played before any child is probed.
+    const auto& wins = state.get_winning_cells(mark);
+    for (Position pos : open_positions.all()) {
+      if (wins[pos]) {
+        return pos;
+      }
+    }
+    BoardValue win = mark == Mark::X ? BoardValue::X_WIN : BoardValue::O_WIN;
+    int best_rank = -1;
+    for (Position pos : open_positions.all()) {
+      State<N, D> cloned(state);
+      if (cloned.play(pos, mark)) {
+        return pos;
+      }
+      auto result = tablebase.probe(cloned, flip(mark));
+      if (!result.has_value()) {
+        optional<Position> empty = {};
+        return empty;
+      }
+      int rank = *result == win ? 2 : *result == BoardValue::DRAW ? 1 : 0;
+      if (rank > best_rank) {
+        best_rank = rank;
+        best = pos;
+      }
+    }
+    return best;
+  }
+};
+
+#endif
@@ -1,5 +1,13 @@
 #include "tictactoe.hh"
+#include "batch.hh"
+#include "book.hh"
+#include "server.hh"
+#include "selfplay.hh"
+#include "tournament.hh"
+#include "record.hh"
+#include "reference.hh"
 #include "elevator.hh"
+#include "fenwick.hh"
 #include "gtest/gtest.h"
 
 namespace {
@@ -294,6 +302,815 @@ TEST(ElevatorTest, One) {
   EXPECT_TRUE(elevator.one(2_mcount, Mark::X));
 }
 
+TEST(FenwickTreeTest, PrefixSums) {
+  sarray<Position, LineCount, 9> weights{
+      3_lcount, 2_lcount, 3_lcount, 2_lcount, 4_lcount,
+      2_lcount, 3_lcount, 2_lcount, 3_lcount};
+  FenwickTree<3, 2> tree(weights);
+  EXPECT_EQ(24, tree.total());
+  EXPECT_EQ(0, tree.prefix(0_pos));
+  EXPECT_EQ(8, tree.prefix(3_pos));
+  tree.add(4_pos, -4);
+  EXPECT_EQ(20, tree.total());
+  EXPECT_EQ(10, tree.prefix(5_pos));
+}
+
+TEST(FenwickTreeTest, FindMatchesLinearScan) {
+  sarray<Position, LineCount, 9> weights{
+      3_lcount, 0_lcount, 3_lcount, 2_lcount, 4_lcount,
+      0_lcount, 3_lcount, 2_lcount, 3_lcount};
+  FenwickTree<3, 2> tree(weights);
+  for (int value = 0; value < tree.total(); ++value) {
+    int previous = 0;
+    for (Position pos = 0_pos; pos < 9_pos; ++pos) {
+      int current = previous + weights[pos];
+      if (value < current) {
+        EXPECT_EQ(pos, tree.find(value));
+        break;
+      }
+      previous = current;
+    }
+  }
+}
+
+TEST(StateTest, TotalWeightTracksAccumulation) {
+  BoardData<4, 3> data;
+  State state(data);
+  state.play({0_side, 0_side, 0_side}, Mark::X);
+  state.play({1_side, 1_side, 0_side}, Mark::O);
+  state.play({3_side, 0_side, 0_side}, Mark::X);
+  state.play({2_side, 0_side, 0_side}, Mark::O);
+  int expected = 0;
+  int empty = 0;
+  for (Position pos = 0_pos; pos < state.board_size; ++pos) {
+    if (state.get_board(pos) == Mark::empty) {
+      expected += state.get_current_accumulation(pos);
+      empty += state.get_current_accumulation(pos) > 0;
+    }
+  }
+  EXPECT_EQ(expected, state.get_total_weight());
+  EXPECT_EQ(empty, state.get_empty_count());
+}
+
+TEST(HeatMapCacheTest, SymmetricPositionHits) {
+  BoardData<3, 2> data;
+  HeatMapCache<3, 2> cache(data);
+  int computed = 0;
+  auto compute = [&](const State<3, 2>& state) {
+    return [&](const vector<Position>& open) {
+      computed++;
+      vector<int> scores;
+      for (Position pos : open) {
+        scores.push_back(state.get_current_accumulation(pos));
+      }
+      return scores;
+    };
+  };
+  State first(data);
+  first.play({0_side, 0_side}, Mark::X);
+  auto open = first.get_open_positions(Mark::O).get_vector();
+  auto expected = cache.get_scores(first, Mark::O, open, compute(first));
+  State second(data);
+  second.play({2_side, 2_side}, Mark::X);
+  auto other = second.get_open_positions(Mark::O).get_vector();
+  auto actual = cache.get_scores(second, Mark::O, other, compute(second));
+  EXPECT_EQ(1, computed);
+  EXPECT_EQ(1, cache.get_hits());
+  EXPECT_EQ(1, cache.get_misses());
+  sort(begin(expected), end(expected));
+  sort(begin(actual), end(actual));
+  EXPECT_EQ(expected, actual);
+}
+
+TEST(HeatMapCacheTest, EvictsLeastRecentlyUsed) {
+  BoardData<3, 2> data;
+  HeatMapCache<3, 2> cache(data, 1);
+  auto compute = [](const vector<Position>& open) {
+    return vector<int>(open.size(), 1);
+  };
+  State first(data);
+  first.play({1_side, 1_side}, Mark::X);
+  State second(data);
+  second.play({0_side, 1_side}, Mark::X);
+  auto open = first.get_open_positions(Mark::O).get_vector();
+  cache.get_scores(first, Mark::O, open, compute);
+  cache.get_scores(second, Mark::O,
+      second.get_open_positions(Mark::O).get_vector(), compute);
+  cache.get_scores(first, Mark::O, open, compute);
+  EXPECT_EQ(0, cache.get_hits());
+  EXPECT_EQ(3, cache.get_misses());
+  EXPECT_EQ(1, cache.size());
+}
+
+TEST(RolloutPolicyTest, MatchesForcingChain) {
+  BoardData<4, 2> data;
+  State state(data);
+  default_random_engine generator(1);
+  state.play({0_side, 0_side}, Mark::X);
+  state.play({0_side, 1_side}, Mark::X);
+  state.play({2_side, 3_side}, Mark::X);
+  state.play({3_side, 3_side}, Mark::X);
+  auto chain = ForcingMove(state) >> ForcingStrategy(state, data);
+  RolloutPolicy policy(state, generator);
+  for (Mark mark : {Mark::X, Mark::O}) {
+    auto open_positions = state.get_open_positions(mark);
+    auto expected = chain(mark, open_positions);
+    EXPECT_TRUE(expected.has_value());
+    EXPECT_EQ(expected, policy.forced(mark, open_positions));
+  }
+}
+
+TEST(StateTest, ThreatCellsMatchLineScan) {
+  BoardData<4, 3> data;
+  default_random_engine generator(3);
+  for (int game = 0; game < 20; ++game) {
+    State state(data);
+    Mark mark = Mark::X;
+    for (Position ply = 0_pos; ply < data.board_size; ++ply) {
+      auto open_positions = state.get_open_positions(mark);
+      vector<Position> cells = open_positions.get_vector();
+      if (cells.empty()) {
+        break;
+      }
+      Position move = cells[generator() % cells.size()];
+      if (state.play(move, mark)) {
+        break;
+      }
+      mark = flip(mark);
+      for (Mark side : {Mark::X, Mark::O}) {
+        Bitfield<4, 3> wins;
+        for (Line line : state.get_line_marks(MarkCount{3}, side)) {
+          wins.set(state.get_xor_table(line));
+        }
+        EXPECT_EQ(wins.get_vector(),
+                  state.get_winning_cells(side).get_vector());
+        for (Position cell = 0_pos; cell < data.board_size; ++cell) {
+          int threats = 0;
+          for (Line line : data.lines_through_position()[cell]) {
+            threats += state.check_line(line, MarkCount{2}, side);
+          }
+          EXPECT_EQ(threats >= 2, state.get_double_threats(side)[cell]);
+        }
+      }
+    }
+  }
+}
+
+TEST(BatchStrategyTest, MatchesSingleGameChain) {
+  BoardData<4, 3> data;
+  default_random_engine generator(5);
+  vector<State<4, 3>> states;
+  for (int game = 0; game < 30; ++game) {
+    State state(data);
+    BiasedRandom random(state, generator);
+    Mark mark = Mark::X;
+    for (int ply = 0; ply < 12; ++ply) {
+      state.play(*random(mark, state.get_open_positions(mark)), mark);
+      mark = flip(mark);
+    }
+    states.push_back(state);
+  }
+  GameBatch<4, 3> batch;
+  for (const auto& state : states) {
+    batch.states.push_back(&state);
+    batch.open_positions.push_back(state.get_open_positions(Mark::X));
+  }
+  vector<optional<Position>> moves(batch.size());
+  auto chain = BatchForcingMove<4, 3>() >> BatchForcingStrategy<4, 3>();
+  chain(Mark::X, batch, moves);
+  auto adapted = batched<4, 3>([&](const auto& state) {
+    return ForcingMove(state) >> ForcingStrategy(state, data);
+  });
+  int forced = 0;
+  for (int i = 0; i < batch.size(); ++i) {
+    auto single = ForcingMove(states[i]) >> ForcingStrategy(states[i], data);
+    auto expected = single(Mark::X, batch.open_positions[i]);
+    EXPECT_EQ(expected, moves[i]);
+    Unbatched unbatched(states[i], adapted);
+    EXPECT_EQ(expected, unbatched(Mark::X, batch.open_positions[i]));
+    forced += expected.has_value();
+  }
+  EXPECT_GT(forced, 0);
+}
+
+TEST(BatchGameEngineTest, PlaysEveryGameToTheEnd) {
+  BoardData<3, 2> data;
+  default_random_engine generator(2);
+  vector<State<3, 2>> states(20, State(data));
+  BatchGameEngine engine(span<State<3, 2>>(states),
+      BatchForcingMove<3, 2>() >> BatchBiasedRandom<3, 2>(generator));
+  vector<Mark> winners = engine.play(Mark::X);
+  ASSERT_EQ(20, static_cast<int>(winners.size()));
+  for (int i = 0; i < 20; ++i) {
+    if (winners[i] == Mark::empty) {
+      EXPECT_TRUE(states[i].get_open_positions(Mark::X).none());
+    }
+  }
+}
+
+TEST(CombinerTest, SharedAnalysisKeepsMoves) {
+  BoardData<4, 3> data;
+  default_random_engine generator(7);
+  for (int game = 0; game < 20; ++game) {
+    State state(data);
+    Mark mark = Mark::X;
+    for (int ply = 0; ply < 30; ++ply) {
+      auto open_positions = state.get_open_positions(mark);
+      if (open_positions.none()) {
+        break;
+      }
+      default_random_engine chained_generator(ply);
+      default_random_engine single_generator(ply);
+      auto chain =
+          ForcingMove(state) >>
+          ForcingStrategy(state, data) >>
+          BiasedRandom(state, chained_generator);
+      auto expected =
+          ForcingMove(state)(mark, open_positions) ||
+          [&](){ return ForcingStrategy(state, data)(mark, open_positions); } ||
+          [&](){
+            return BiasedRandom(state, single_generator)(mark, open_positions);
+          };
+      auto move = chain(mark, open_positions);
+      ASSERT_EQ(expected, move);
+      if (state.play(*move, mark)) {
+        break;
+      }
+      mark = flip(mark);
+    }
+  }
+}
+
+TEST(OpeningBookTest, AnswersSymmetricPositions) {
+  BoardData<3, 2> data;
+  string filename = testing::TempDir() + "book_test.book";
+  BookBuilder builder(data);
+  builder.build(2, [&](const auto& state, Mark mark) {
+    Position pos = 0_pos;
+    while (state.get_board(pos) != Mark::empty) {
+      ++pos;
+    }
+    return make_pair(pos, 0);
+  });
+  builder.write(filename);
+  OpeningBook book(data, filename);
+  // Empty board, plus corner, edge and center for X.
+  EXPECT_EQ(4, book.size());
+  map<uint64_t, uint64_t> replies;
+  for (Position pos = 0_pos; pos < data.board_size; ++pos) {
+    State state(data);
+    state.play(pos, Mark::X);
+    auto move = BookStrategy(state, book)(
+        Mark::O, state.get_open_positions(Mark::O));
+    ASSERT_TRUE(move.has_value());
+    EXPECT_EQ(Mark::empty, state.get_board(*move));
+    uint64_t key = canonical_hash(data, state, Mark::O).first;
+    state.play(*move, Mark::O);
+    uint64_t reply = canonical_hash(data, state, Mark::X).first;
+    auto [it, inserted] = replies.emplace(key, reply);
+    EXPECT_EQ(it->second, reply);
+  }
+  EXPECT_EQ(3, static_cast<int>(replies.size()));
+}
+
+TEST(OpeningBookTest, MissingFileIsEmpty) {
+  BoardData<3, 2> data;
+  State state(data);
+  OpeningBook book(data, testing::TempDir() + "no_such.book");
+  EXPECT_EQ(0, book.size());
+  EXPECT_FALSE(book.find(state, Mark::X).has_value());
+}
+
+template<int N, int D>
+BoardValue negamax(const State<N, D>& state, Mark mark) {
+  BoardValue win = mark == Mark::X ? BoardValue::X_WIN : BoardValue::O_WIN;
+  BoardValue best = mark == Mark::X ? BoardValue::O_WIN : BoardValue::X_WIN;
+  auto open_positions = state.get_open_positions(mark);
+  if (open_positions.none()) {
+    return BoardValue::DRAW;
+  }
+  for (Position pos : open_positions.all()) {
+    State<N, D> cloned(state);
+    if (cloned.play(pos, mark)) {
+      return win;
+    }
+    BoardValue result = negamax(cloned, flip(mark));
+    if (result == win) {
+      return win;
+    }
+    if (result == BoardValue::DRAW) {
+      best = result;
+    }
+  }
+  return best;
+}
+
+TEST(TablebaseTest, MatchesSearchOnRandomPositions) {
+  BoardData<4, 2> data;
+  string filename = testing::TempDir() + "tablebase_test.tb";
+  TablebaseBuilder<4, 2> builder(data, 8);
+  default_random_engine generator(11);
+  builder.build_sampled(50, [&](const auto& state) {
+    return BiasedRandom(state, generator);
+  });
+  builder.write(filename);
+  Tablebase<4, 2> tablebase(data, filename);
+  EXPECT_EQ(8, tablebase.get_max_empty());
+  int probed = 0;
+  for (int game = 0; game < 200; ++game) {
+    State state(data);
+    BiasedRandom random(state, generator);
+    Mark mark = Mark::X;
+    bool finished = false;
+    while (!finished && state.get_empty_count() > 8) {
+      auto open_positions = state.get_open_positions(mark);
+      finished = open_positions.none() ||
+          state.play(*random(mark, open_positions), mark);
+      mark = flip(mark);
+    }
+    if (finished) {
+      continue;
+    }
+    if (auto known = tablebase.probe(state, mark); known.has_value()) {
+      EXPECT_EQ(negamax(state, mark), *known);
+      probed++;
+    }
+  }
+  EXPECT_GT(probed, 0);
+  // X wins at once, but the position is above the table's range.
+  State state(data);
+  state.play({0_side, 0_side}, Mark::X);
+  state.play({1_side, 0_side}, Mark::O);
+  state.play({0_side, 1_side}, Mark::X);
+  state.play({1_side, 1_side}, Mark::O);
+  state.play({0_side, 2_side}, Mark::X);
+  state.play({1_side, 2_side}, Mark::O);
+  EXPECT_FALSE(tablebase.probe(state, Mark::X).has_value());
+}
+
+TEST(TablebaseTest, FullTableSolvesRoot) {
+  BoardData<3, 2> data;
+  string filename = testing::TempDir() + "tablebase_full.tb";
+  TablebaseBuilder<3, 2> builder(data, 9);
+  EXPECT_EQ(BoardValue::DRAW, builder.build_full());
+  builder.write(filename);
+  Tablebase<3, 2> tablebase(data, filename);
+  State state(data);
+  EXPECT_EQ(BoardValue::DRAW, tablebase.probe(state, Mark::X));
+  state.play({0_side, 0_side}, Mark::X);
+  state.play({0_side, 1_side}, Mark::O);
+  EXPECT_EQ(BoardValue::X_WIN, tablebase.probe(state, Mark::X));
+  auto move = TablebaseStrategy(state, tablebase)(
+      Mark::X, state.get_open_positions(Mark::X));
+  ASSERT_TRUE(move.has_value());
+  state.play(*move, Mark::X);
+  EXPECT_EQ(BoardValue::X_WIN, tablebase.probe(state, Mark::O));
+}
+
+TEST(MoveServiceTest, AnswersFromTablebase) {
+  BoardData<3, 2> data;
+  string filename = testing::TempDir() + "server_test.tb";
+  TablebaseBuilder<3, 2> builder(data, 9);
+  builder.build_full();
+  builder.write(filename);
+  MoveService service({filename});
+  EXPECT_TRUE(service.handle(".........").ends_with(" D"));
+  // X to play can complete the top row.
+  EXPECT_EQ("2 X", service.handle("XX.OO...."));
+  EXPECT_EQ("error unknown board", service.handle("...."));
+  EXPECT_EQ("error bad cell", service.handle("XX.OO...?"));
+  // Cell 8 is dead by the time it is set up; O completes the middle row.
+  EXPECT_EQ("3 O", service.handle("X.X.OOOXX"));
+  EXPECT_EQ("error bad mark count", service.handle("XX......."));
+  EXPECT_EQ("error bad mark count", service.handle("O........"));
+  EXPECT_EQ("error game over", service.handle("XXXOO...."));
+  EXPECT_EQ("error game over", service.handle("XXOOOXXXO"));
+  EXPECT_EQ(9, service.get_latency().count());
+  EXPECT_TRUE(service.handle("stats").starts_with("requests 9 "));
+}
+
+TEST(MiniMaxTest, WonNodesKeepTheirMove) {
+  BoardData<3, 2> data;
+  string filename = testing::TempDir() + "minimax_test.tb";
+  TablebaseBuilder<3, 2> builder(data, 5);
+  builder.build_full();
+  builder.write(filename);
+  Tablebase<3, 2> tablebase(data, filename);
+  // Nodes settled by chaining, a forcing move or the tablebase are won
+  // too, and must name a move for the book.
+  array<const Tablebase<3, 2>*, 2> tables{nullptr, &tablebase};
+  for (const auto *table : tables) {
+    State state(data);
+    default_random_engine generator(1);
+    MiniMax<3, 2> minimax(state, data, generator, false, table);
+    minimax.play(state, Mark::X);
+    int won = 0;
+    auto check = [&](auto& self, const SolutionTree::Node *node,
+                     Mark mark) -> void {
+      if (node->value == minimax.winner(mark)) {
+        won++;
+        EXPECT_TRUE(any_of(begin(node->children), end(node->children),
+            [&](const auto& child) {
+              return child.second->value == node->value;
+            }));
+      }
+      for (const auto& [pos, child] : node->children) {
+        self(self, child.get(), flip(mark));
+      }
+    };
+    check(check, minimax.solution.get_root(), Mark::X);
+    EXPECT_GT(won, 0);
+    EXPECT_EQ(table != nullptr, minimax.tablebase_hits > 0);
+  }
+}
+
+TEST(MiniMaxTest, FollowingTheTableIsOneHit) {
+  BoardData<3, 2> data;
+  string filename = testing::TempDir() + "minimax_full.tb";
+  TablebaseBuilder<3, 2> builder(data, 9);
+  builder.build_full();
+  builder.write(filename);
+  Tablebase<3, 2> tablebase(data, filename);
+  State state(data);
+  default_random_engine generator(1);
+  MiniMax<3, 2> minimax(state, data, generator, false, &tablebase);
+  EXPECT_EQ(BoardValue::DRAW, minimax.play(state, Mark::X));
+  // The root probe settles the game; the line below it is not re-probed.
+  EXPECT_EQ(1, minimax.tablebase_hits);
+  int plies = 0;
+  for (auto *node = minimax.solution.get_root(); !node->children.empty();
+       node = begin(node->children)->second.get()) {
+    plies++;
+  }
+  EXPECT_GT(plies, 0);
+}
+
+TEST(SelfPlayTest, SameSeedSameTotals) {
+  BoardData<3, 2> data;
+  auto make_strategy = [](const auto& state, auto& generator) {
+    return BiasedRandom(state, generator);
+  };
+  auto play = [&](int threads) {
+    SelfPlay<3, 2, decltype(make_strategy)> runner(
+        data, make_strategy, 42, threads);
+    return runner.run(1000, chrono::seconds(10), [](const auto& x) {});
+  };
+  auto stats = play(3);
+  EXPECT_EQ(1000, stats.games);
+  EXPECT_EQ(1000, stats.wins[0] + stats.wins[1] + stats.wins[2]);
+  EXPECT_EQ(1000, stats.reached[0]);
+  EXPECT_EQ(stats.wins, play(3).wins);
+  EXPECT_EQ(stats.lengths, play(3).lengths);
+}
+
+template<int N, int D>
+long long tree_size(const State<N, D>& state, Mark mark) {
+  long long nodes = 1;
+  auto open_positions = state.get_open_positions(mark);
+  for (Position pos : open_positions.all()) {
+    State<N, D> cloned(state);
+    nodes += cloned.play(pos, mark) ? 1 : tree_size(cloned, flip(mark));
+  }
+  return nodes;
+}
+
+TEST(SelfPlayTest, KnuthEstimatesTreeSize) {
+  BoardData<3, 2> data;
+  auto make_strategy = [](const auto& state, auto& generator) {
+    return UniformRandom<3, 2>(generator);
+  };
+  SelfPlay<3, 2, decltype(make_strategy)> runner(data, make_strategy, 7, 2);
+  auto stats = runner.run(20000, chrono::seconds(10), [](const auto& x) {});
+  double exact = tree_size(State<3, 2>(data), Mark::X);
+  EXPECT_NEAR(exact, stats.knuth_mean(), 2 * stats.knuth_error());
+}
+
+TEST(SelfPlayTest, UnboundedRunStopsOnTime) {
+  BoardData<3, 2> data;
+  auto make_strategy = [](const auto& state, auto& generator) {
+    return UniformRandom<3, 2>(generator);
+  };
+  SelfPlay<3, 2, decltype(make_strategy)> runner(data, make_strategy, 7, 3);
+  auto deadline = chrono::steady_clock::now() + chrono::milliseconds(200);
+  auto stats = runner.run_until(numeric_limits<long long>::max(),
+      chrono::milliseconds(20), [](const auto& x) {}, [&](const auto& x) {
+    return chrono::steady_clock::now() > deadline;
+  });
+  EXPECT_GT(stats.games, 0);
+  EXPECT_EQ(stats.games, accumulate(
+      stats.wins.begin(), stats.wins.end(), 0LL));
+}
+
+TEST(TournamentTest, EloOfThreeToOne) {
+  auto elo = elo_ratings({{0, 750}, {250, 0}}, {{0, 1000}, {1000, 0}});
+  // 400 log10(3) is 190.8.
+  EXPECT_NEAR(190.8, elo[0].elo - elo[1].elo, 1.0);
+  EXPECT_NEAR(0.0, elo[0].elo + elo[1].elo, 1e-9);
+  EXPECT_LT(elo[0].error, 30.0);
+}
+
+TEST(TournamentTest, ResultsIgnoreThreadCount) {
+  BoardData<3, 2> data;
+  auto play = [&](int threads) {
+    Tournament<3, 2> tournament(data, 5, threads);
+    tournament.add("random", [](const auto& state, auto& generator) {
+      return Tournament<3, 2>::Player(BiasedRandom(state, generator));
+    });
+    tournament.add("forcing", [&](const auto& state, auto& generator) {
+      return Tournament<3, 2>::Player(
+          ForcingMove(state) >> BiasedRandom(state, generator));
+    });
+    tournament.play(100);
+    return tournament.get_points();
+  };
+  auto points = play(1);
+  EXPECT_EQ(100.0, points[0][1] + points[1][0]);
+  EXPECT_GT(points[1][0], points[0][1]);
+  EXPECT_EQ(points, play(3));
+}
+
+TEST(SearchStatsTest, WritesBothTables) {
+  SearchStats stats;
+  stats.add(2, 7, [](auto& level) {
+    level.nodes++;
+    level.open += 7;
+    level.expanded++;
+    level.cutoffs++;
+    SearchStats::add_rank(level, 3);
+  });
+  ostringstream os;
+  stats.write_json(os);
+  string json = os.str();
+  EXPECT_NE(string::npos, json.find(
+      "{\"depth\": 2, \"nodes\": 1, \"branching\": 7,"));
+  EXPECT_NE(string::npos, json.find("{\"open\": 7, \"nodes\": 1,"));
+  EXPECT_NE(string::npos, json.find("\"best_rank\": [0, 0, 0, 1]"));
+  EXPECT_NE(string::npos, json.find("{\"depth\": 0, \"nodes\": 0,"));
+}
+
+TEST(MemoryTest, ParsesCaps) {
+  auto caps = parse_memory_caps("solution_tree=2G,heatmap=100M,minimax=4096");
+  ASSERT_TRUE(caps.has_value());
+  EXPECT_EQ(2LL << 30, (*caps)[static_cast<int>(MemoryTag::solution_tree)]);
+  EXPECT_EQ(100LL << 20, (*caps)[static_cast<int>(MemoryTag::heatmap)]);
+  EXPECT_EQ(4096, (*caps)[static_cast<int>(MemoryTag::minimax)]);
+  EXPECT_EQ(0, (*caps)[static_cast<int>(MemoryTag::symmetrie)]);
+  EXPECT_FALSE(parse_memory_caps("heap=1M").has_value());
+  EXPECT_FALSE(parse_memory_caps("heatmap=1X").has_value());
+  EXPECT_FALSE(parse_memory_caps("heatmap").has_value());
+}
+
+TEST(RecordTest, RoundTripsAndReplays) {
+  using Format = GameRecordFormat<4, 2>;
+  BoardData<4, 2> data;
+  default_random_engine generator(7);
+  vector<GameRecord> games(20);
+  stringstream ss;
+  Format::write_header(ss);
+  for (auto& game : games) {
+    State state(data);
+    GameEngine engine(generator, state, BiasedRandom(state, generator));
+    game.winner = engine.play(
+        Mark::X, [](auto x){}, GameRecorder(game));
+    Format::write(ss, game);
+  }
+  GameRecord pass;
+  pass.moves = {0_pos, {}, 5_pos};
+  Format::write(ss, pass);
+  ASSERT_TRUE(Format::read_header(ss));
+  GameRecord read;
+  for (const auto& game : games) {
+    ASSERT_TRUE(Format::read(ss, read));
+    EXPECT_EQ(game.winner, read.winner);
+    EXPECT_EQ(game.moves, read.moves);
+    State state(data);
+    GameEngine engine(generator, state, ReplayStrategy(read));
+    EXPECT_EQ(game.winner, engine.play(read.start));
+    EXPECT_FALSE(engine.strategy.has_diverged());
+    EXPECT_TRUE(engine.strategy.followed_record());
+  }
+  // A game that ends before its record does is not a faithful replay.
+  GameRecord longer = games.front();
+  longer.moves.push_back(longer.moves.back());
+  State state(data);
+  GameEngine engine(generator, state, ReplayStrategy(longer));
+  EXPECT_EQ(longer.winner, engine.play(longer.start));
+  EXPECT_FALSE(engine.strategy.has_diverged());
+  EXPECT_FALSE(engine.strategy.followed_record());
+  ASSERT_TRUE(Format::read(ss, read));
+  EXPECT_EQ(pass.moves, read.moves);
+  EXPECT_FALSE(Format::read(ss, read));
+  stringstream other;
+  GameRecordFormat<3, 3>::write_header(other);
+  EXPECT_FALSE(Format::read_header(other));
+}
+
+template<int N, int D>
+void expect_agreement(unsigned seed, int games) {
+  BoardData<N, D> data;
+  for (int game = 0; game < games; ++game) {
+    seed_seq sequence{seed, static_cast<unsigned>(game)};
+    default_random_engine generator(sequence);
+    GameRecord record;
+    auto found = differential_game<N, D, State<N, D>>(data, generator, record);
+    EXPECT_FALSE(found.has_value())
+        << N << "^" << D << " game " << game << ": " << found.value_or("");
+  }
+}
+
+TEST(ReferenceTest, StateAgreesWithOracle) {
+  expect_agreement<3, 2>(1, 200);
+  expect_agreement<4, 2>(2, 200);
+  expect_agreement<3, 3>(3, 100);
+  expect_agreement<4, 3>(4, 20);
+  expect_agreement<5, 3>(5, 5);
+}
+
+TEST(ReferenceTest, OracleCatchesABrokenBackend) {
+  // State that always offers the corner, even once it is played.
+  struct Forgetful : State<3, 2> {
+    using State<3, 2>::State;
+    Bitfield<3, 2> get_open_positions(Mark mark) const {
+      auto open = State<3, 2>::get_open_positions(mark);
+      open.set(0_pos);
+      return open;
+    }
+  };
+  BoardData<3, 2> data;
+  default_random_engine generator(1);
+  GameRecord record;
+  auto found = differential_game<3, 2, Forgetful>(data, generator, record);
+  ASSERT_TRUE(found.has_value());
+  EXPECT_NE(string::npos, found->find("open positions"));
+  EXPECT_EQ(1u, record.moves.size());
+}
+
+TEST(AmafTableTest, CreditsEveryMoveOfTheSide) {
+  AmafTable<3, 2> amaf;
+  vector<pair<Mark, Position>> moves{
+      {Mark::X, 4_pos}, {Mark::O, 0_pos}, {Mark::X, 2_pos}};
+  amaf.update(Mark::X, Mark::X, moves);
+  amaf.update(Mark::O, Mark::X, moves);
+  EXPECT_EQ(1, amaf.get_visits(4_pos));
+  EXPECT_EQ(1, amaf.get_score(2_pos));
+  EXPECT_EQ(1, amaf.get_visits(0_pos));
+  EXPECT_EQ(-1, amaf.get_score(0_pos));
+  EXPECT_EQ(0, amaf.get_visits(8_pos));
+  EXPECT_DOUBLE_EQ(0.5, amaf.blend(8_pos, 0.5, 10, 100));
+  EXPECT_DOUBLE_EQ(1.0, amaf.blend(4_pos, 1.0, 10, 100));
+}
+
+TEST(AmafTableTest, RecorderAlternatesMarks) {
+  BoardData<3, 2> data;
+  State state(data);
+  vector<pair<Mark, Position>> moves;
+  MoveRecorder recorder(Mark::O, moves);
+  recorder(state, 4_pos);
+  recorder(state, {});
+  recorder(state, 1_pos);
+  vector<pair<Mark, Position>> expected{
+      {Mark::O, 4_pos}, {Mark::O, 1_pos}};
+  EXPECT_EQ(expected, moves);
+}
+
+TEST(BiasedRandomTest, StratifiedFollowsWeights) {
+  BoardData<3, 2> data;
+  State state(data);
+  default_random_engine generator(1);
+  BiasedRandom random(state, generator);
+  auto open_positions = state.get_open_positions(Mark::X);
+  int total = random.total_weight(open_positions);
+  map<Position, int> picked;
+  for (int i = 0; i < total; ++i) {
+    double fraction = (i + 0.5) / total;
+    picked[random.stratified(open_positions, fraction)]++;
+  }
+  for (Position pos : open_positions.all()) {
+    EXPECT_EQ(state.get_current_accumulation(pos), picked[pos]);
+  }
+}
+
+TEST(HeatMapTest, ReportsErrorPerMove) {
+  BoardData<3, 2> data;
+  State state(data);
+  default_random_engine generator(1);
+  Sampling sampling;
+  sampling.common_random = true;
+  sampling.stratified = true;
+  HeatMap heatmap(state, data, generator, 10, false, 0, sampling);
+  auto open = state.get_open_positions(Mark::X).get_vector();
+  auto scores = heatmap.get_scores(Mark::X, open);
+  EXPECT_EQ(open.size(), scores.size());
+  EXPECT_EQ(open.size(), heatmap.errors.size());
+  for (double error : heatmap.errors) {
+    EXPECT_LE(0.0, error);
+  }
+}
+
+TEST(StateTest, HashIgnoresMoveOrder) {
+  BoardData<4, 2> data;
+  State first(data);
+  first.play({0_side, 0_side}, Mark::X);
+  first.play({1_side, 2_side}, Mark::O);
+  first.play({3_side, 1_side}, Mark::X);
+  State second(data);
+  second.play({3_side, 1_side}, Mark::X);
+  second.play({1_side, 2_side}, Mark::O);
+  EXPECT_NE(first.get_hash(), second.get_hash());
+  second.play({0_side, 0_side}, Mark::X);
+  EXPECT_EQ(first.get_hash(), second.get_hash());
+}
+
+TEST(ChainingStrategyTest, MemoizesProvenChain) {
+  BoardData<4, 2> data;
+  State state(data);
+  state.play({0_side, 0_side}, Mark::X);
+  state.play({0_side, 1_side}, Mark::X);
+  state.play({2_side, 3_side}, Mark::X);
+  state.play({3_side, 3_side}, Mark::X);
+  ChainingMemo memo;
+  ChainingStrategy first(state, &memo);
+  auto expected = first.search(Mark::X);
+  EXPECT_TRUE(expected.has_value());
+  EXPECT_LT(0, first.visited);
+  ChainingStrategy second(state, &memo);
+  EXPECT_EQ(expected, second.search(Mark::X));
+  EXPECT_EQ(0, second.visited);
+  EXPECT_EQ(1, second.memo_hits);
+}
+
+TEST(ChainingStrategyTest, StopsAtBudget) {
+  BoardData<4, 2> data;
+  State state(data);
+  state.play({0_side, 0_side}, Mark::X);
+  state.play({0_side, 1_side}, Mark::X);
+  state.play({2_side, 3_side}, Mark::X);
+  state.play({3_side, 3_side}, Mark::X);
+  ChainingMemo memo;
+  ChainingStrategy strat(state, &memo, 0);
+  EXPECT_FALSE(strat.search(Mark::X).has_value());
+  EXPECT_TRUE(strat.exhausted);
+  EXPECT_FALSE(memo.find(state.get_hash(), Mark::X).has_value());
+}
+
+TEST(ThreatSpaceSearchTest, FindsCrossOfX) {
+  BoardData<4, 2> data;
+  State state(data);
+  state.play({0_side, 0_side}, Mark::X);
+  state.play({0_side, 1_side}, Mark::X);
+  state.play({2_side, 3_side}, Mark::X);
+  state.play({3_side, 3_side}, Mark::X);
+  ThreatSpaceSearch search(state, data);
+  EXPECT_TRUE(search.search(Mark::X).has_value());
+  EXPECT_FALSE(search.search(Mark::O).has_value());
+}
+
+TEST(ThreatSpaceSearchTest, RespectsOpponentFour) {
+  BoardData<4, 2> data;
+  State state(data);
+  state.play({0_side, 0_side}, Mark::X);
+  state.play({0_side, 1_side}, Mark::X);
+  state.play({2_side, 3_side}, Mark::X);
+  state.play({3_side, 3_side}, Mark::X);
+  state.play({3_side, 0_side}, Mark::O);
+  state.play({2_side, 1_side}, Mark::O);
+  state.play({1_side, 2_side}, Mark::O);
+  ThreatSpaceSearch search(state, data);
+  EXPECT_FALSE(search.search(Mark::X).has_value());
+  EXPECT_EQ(data.encode({0_side, 3_side}), *search.search(Mark::O));
+}
+
+TEST(ThreatSpaceSearchTest, VerifyRejectsUnforcedThreats) {
+  // X holds two cells each of the top row, the diagonal and the
+  // anti-diagonal; O blocks everything else.
+  BoardData<4, 2> data;
+  State state(data);
+  for (Position pos : {2_pos, 3_pos, 10_pos, 15_pos, 12_pos}) {
+    state.place(pos, Mark::X);
+  }
+  for (Position pos : {4_pos, 7_pos, 8_pos, 11_pos, 14_pos}) {
+    state.place(pos, Mark::O);
+  }
+  ThreatSpaceSearch search(state, data);
+  EXPECT_TRUE(search.verify(Mark::X, {}, 0_pos));
+  // The row and the diagonal combined: both threats cost cell 0, so the
+  // second one is answered before it is made.
+  EXPECT_FALSE(search.verify(Mark::X, {{1_pos, 0_pos}, {5_pos, 0_pos}}, 9_pos));
+  // Cell 5 makes a four on the diagonal, so O answers at 0 and not 13.
+  EXPECT_FALSE(search.verify(Mark::X, {{5_pos, 13_pos}}, 9_pos));
+}
+
+TEST(ThreatSpaceSearchTest, AgreesWithChainingWins) {
+  BoardData<3, 3> data;
+  State state(data);
+  state.play(13_pos, Mark::X);
+  state.play(0_pos, Mark::O);
+  ChainingStrategy chaining(state);
+  ThreatSpaceSearch search(state, data);
+  EXPECT_TRUE(chaining.search(Mark::X).has_value());
+  EXPECT_TRUE(search.search(Mark::X).has_value());
+}
+
 TEST(ChainingStrategyTest, LineOfX) {
   BoardData<3, 2> data;
   State state(data);
@@ -0,0 +1,334 @@
+#ifndef THREATSPACE_HH
+#define THREATSPACE_HH
+
+#include <unordered_set>
+#include "boarddata.hh"
+#include "state.hh"
+
+// Dependency-based threat-space search (Allis). A threat is a move on a
+// line holding N-2 of the attacker and nothing else; the defender must
+// answer on the last empty cell of that line. The search assumes every
+// answer is forced, grows threat sequences where each threat depends on
+// an earlier gain, combines independent sequences, and then replays any
+// sequence that ends in a double threat on a real State to verify it.
+template<int N, int D>
+class ThreatSpaceSearch {
+ public:
+  ThreatSpaceSearch(
+      const State<N, D>& state, const BoardData<N, D>& data,
+      int max_nodes = 10000)
+      : state(state), data(data), max_nodes(max_nodes), visited(0) {
+  }
+  const State<N, D>& state;
+  const BoardData<N, D>& data;
+  int max_nodes;
+  int visited;
+  constexpr static Position board_size = BoardData<N, D>::board_size;
+  constexpr static Line line_size = BoardData<N, D>::line_size;
+
+  template<typename B>
+  optional<Position> operator()(Mark mark, const B& open_positions) {
+    return search(mark);
+  }
+
+  optional<Position> search(Mark mark) {
+    attacker = mark;
+    for (Line line : state.get_line_marks(MarkCount{N - 1}, mark)) {
+      return state.get_xor_table(line);
+    }
+    if (!state.empty(MarkCount{N - 1}, flip(mark))) {
+      return {};
+    }
+    nodes.clear();
+    seen.clear();
+    by_gain.assign(board_size, {});
+    nodes.push_back(Node{});
+    for (Line line : state.get_line_marks(MarkCount{N - 2}, attacker)) {
+      if (auto win = find_win(nodes.front(), line); win.has_value()) {
+        return win;
+      }
+    }
+    vector<int> added{0};
+    while (!added.empty() && visited < max_nodes) {
+      vector<int> fresh;
+      for (int index : added) {
+        if (auto win = dependency_stage(index, fresh); win.has_value()) {
+          return win;
+        }
+      }
+      added.clear();
+      if (auto win = combination_stage(fresh, added); win.has_value()) {
+        return win;
+      }
+    }
+    return {};
+  }
+
+  // Replays threats (gain, cost) by attacker and then last on a real
+  // board. Every threat must leave the defender its cost as the only
+  // answer (or no answer, for a double threat), and the defender must
+  // never have an immediate win nor get a four of its own from a forced
+  // answer.
+  bool verify(Mark attacker, const vector<pair<Position, Position>>& threats,
+              Position last) const {
+    State<N, D> cloned(state);
+    Mark defender = flip(attacker);
+    for (const auto& [gain, cost] : threats) {
+      if (cloned.get_board(gain) != Mark::empty ||
+          cloned.get_board(cost) != Mark::empty) {
+        return false;
+      }
+      if (cloned.play(gain, attacker)) {
+        return true;
+      }
+      if (!cloned.empty(MarkCount{N - 1}, defender)) {
+        return false;
+      }
+      const auto& wins = cloned.get_winning_cells(attacker);
+      if (wins.count() >= 2) {
+        return true;
+      }
+      if (wins.count() == 0 || !wins[cost]) {
+        return false;
+      }
+      cloned.play(cost, defender);
+      if (!cloned.empty(MarkCount{N - 1}, defender)) {
+        return false;
+      }
+    }
+    if (cloned.get_board(last) != Mark::empty) {
+      return false;
+    }
+    if (cloned.play(last, attacker)) {
+      return true;
+    }
+    if (!cloned.empty(MarkCount{N - 1}, defender)) {
+      return false;
+    }
+    set<Position> fours;
+    for (Line line : cloned.get_line_marks(MarkCount{N - 1}, attacker)) {
+      fours.insert(cloned.get_xor_table(line));
+    }
+    return fours.size() >= 2;
+  }
+
+ private:
+  struct Node {
+    Bitfield<N, D> gains, costs;
+    vector<pair<Position, Position>> threats;
+    bool combined = false;
+  };
+  using Key = bitset<2 * board_size>;
+
+  Mark attacker;
+  vector<Node> nodes;
+  unordered_set<Key> seen;
+  vector<vector<int>> by_gain;
+
+  // Attacker marks on the line counting the node's gains, or -1 if the
+  // defender already holds a cell of it or owns one of its costs.
+  int count(const Node& node, Line line) const {
+    int marks = 0;
+    for (Position pos : data.winning_lines()[line]) {
+      Mark cell = state.get_board(pos);
+      if (cell == flip(attacker) || node.costs[pos]) {
+        return -1;
+      }
+      marks += cell == attacker || node.gains[pos];
+    }
+    return marks;
+  }
+
+  bool free(const Node& node, Position pos) const {
+    return state.get_board(pos) == Mark::empty &&
+           !node.gains[pos] && !node.costs[pos];
+  }
+
+  // Depth-first expansion of threats that depend on the node's gains
+  // (or any line at the root), so long sequences are reached early.
+  optional<Position> dependency_stage(int index, vector<int>& fresh) {
+    vector<int> stack{index};
+    while (!stack.empty()) {
+      if (visited >= max_nodes) {
+        break;
+      }
+      Node node = nodes[stack.back()];
+      stack.pop_back();
+      for (Line line : threat_lines(node)) {
+        vector<Position> empty;
+        for (Position pos : data.winning_lines()[line]) {
+          if (free(node, pos)) {
+            empty.push_back(pos);
+          }
+        }
+        for (auto [gain, cost] : {make_pair(empty[0], empty[1]),
+                                  make_pair(empty[1], empty[0])}) {
+          Node child = node;
+          child.combined = false;
+          child.gains.set(gain);
+          child.costs.set(cost);
+          child.threats.emplace_back(gain, cost);
+          if (!insert(child)) {
+            continue;
+          }
+          if (auto win = find_win(child, gain); win.has_value()) {
+            return win;
+          }
+          stack.push_back(nodes.size() - 1);
+          fresh.push_back(nodes.size() - 1);
+        }
+      }
+    }
+    return {};
+  }
+
+  // Pairs of sequences with compatible squares whose gains meet on a
+  // common line; the union may create threats neither has alone.
+  optional<Position> combination_stage(
+      const vector<int>& fresh, vector<int>& added) {
+    for (int index : fresh) {
+      Position last = nodes[index].threats.back().first;
+      for (Line line : data.lines_through_position()[last]) {
+        for (Position pos : data.winning_lines()[line]) {
+          if (pos == last) {
+            continue;
+          }
+          for (int i = 0; i < static_cast<int>(by_gain[pos].size()); ++i) {
+            if (visited >= max_nodes) {
+              return {};
+            }
+            int other = by_gain[pos][i];
+            if (!compatible(nodes[index], nodes[other])) {
+              visited++;
+              continue;
+            }
+            Node child = nodes[index];
+            child.combined = true;
+            vector<pair<Position, Position>> threats = nodes[other].threats;
+            for (const auto& [gain, cost] : threats) {
+              if (!child.gains[gain]) {
+                child.gains.set(gain);
+                child.costs.set(cost);
+                child.threats.emplace_back(gain, cost);
+              }
+            }
+            if (!insert(child)) {
+              continue;
+            }
+            for (const auto& [gain, cost] : threats) {
+              if (auto win = find_win(child, gain); win.has_value()) {
+                return win;
+              }
+            }
+            added.push_back(nodes.size() - 1);
+          }
+        }
+      }
+    }
+    return {};
+  }
+
+  bool compatible(const Node& a, const Node& b) const {
+    return !blocks(a, b) && !blocks(b, a);
+  }
+
+  // Whether a cost of a lands on the line of a threat of b that a does
+  // not share; the defender would hold a cell of it before the threat is
+  // made, so it would not force.
+  bool blocks(const Node& a, const Node& b) const {
+    for (const auto& [gain, cost] : b.threats) {
+      if (a.gains[gain] && a.costs[cost]) {
+        continue;
+      }
+      for (Position pos : data.winning_lines()[threat_line(gain, cost)]) {
+        if (a.costs[pos]) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // The one line through both cells of a threat.
+  Line threat_line(Position gain, Position cost) const {
+    for (Line line : data.lines_through_position()[gain]) {
+      const auto& cells = data.winning_lines()[line];
+      if (find(begin(cells), end(cells), cost) != end(cells)) {
+        return line;
+      }
+    }
+    assert(false);
+  }
+
+  // Every generated node counts against the budget, duplicates included.
+  bool insert(const Node& node) {
+    visited++;
+    Key key;
+    for (Position pos = 0_pos; pos < board_size; ++pos) {
+      key[2 * pos] = node.gains[pos];
+      key[2 * pos + 1] = node.costs[pos];
+    }
+    if (!seen.insert(key).second) {
+      return false;
+    }
+    nodes.push_back(node);
+    for (const auto& [gain, cost] : node.threats) {
+      by_gain[gain].push_back(nodes.size() - 1);
+    }
+    return true;
+  }
+
+  vector<Line> threat_lines(const Node& node) const {
+    vector<Line> lines;
+    if (node.threats.empty()) {
+      for (Line line : state.get_line_marks(MarkCount{N - 2}, attacker)) {
+        lines.push_back(line);
+      }
+      return lines;
+    }
+    // Chains only extend from their newest gain; a combination may open
+    // threats through the gains of either side.
+    auto first = node.combined ? begin(node.threats) : prev(end(node.threats));
+    for (const auto& [gain, cost] : ranges::subrange(first, end(node.threats))) {
+      for (Line line : data.lines_through_position()[gain]) {
+        if (count(node, line) == N - 2 &&
+            find(begin(lines), end(lines), line) == end(lines)) {
+          lines.push_back(line);
+        }
+      }
+    }
+    return lines;
+  }
+
+  // A free cell crossed by two open lines with N-2 attacker marks, on a
+  // line through the given gain, is a double threat once played.
+  optional<Position> find_win(const Node& node, Position gain) {
+    for (Line line : data.lines_through_position()[gain]) {
+      if (auto win = find_win(node, line); win.has_value()) {
+        return win;
+      }
+    }
+    return {};
+  }
+
+  optional<Position> find_win(const Node& node, Line line) {
+    if (count(node, line) != N - 2) {
+      return {};
+    }
+    for (Position pos : data.winning_lines()[line]) {
+      if (!free(node, pos)) {
+        continue;
+      }
+      int threats = 0;
+      for (Line other : data.lines_through_position()[pos]) {
+        threats += count(node, other) == N - 2;
+      }
+      if (threats >= 2 && verify(attacker, node.threats, pos)) {
+        return node.threats.empty() ? pos : node.threats.front().first;
+      }
+    }
+    return {};
+  }
+};
+
+#endif
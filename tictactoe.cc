@@ -12,11 +12,13 @@
 #include <list>
 #include "tictactoe.hh"
 
-int main() {
+// Usage: tictactoe [seed]
+int main(int argc, char **argv) {
   BoardData<5, 3> data;
   cout << "num symmetries " << data.symmetries_size() << "\n";
   vector<int> search_tree(data.board_size);
-  unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+  unsigned seed = seed_argument(argc, argv, 1);
+  cerr << "seed " << seed << "\n";
   default_random_engine generator(seed);
   int max_plays = 100;
   vector<int> win_counts(3);
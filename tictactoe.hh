@@ -12,10 +12,20 @@
 #include <bitset>
 #include <execution>
 #include <list>
+#include <mutex>
+#include <limits>
+#include <unordered_map>
 #include "semantic.hh"
 #include "boarddata.hh"
 #include "state.hh"
 #include "solutiontree.hh"
+#include "heatcache.hh"
+#include "amaf.hh"
+#include "threatspace.hh"
+#include "tablebase.hh"
+#include "metrics.hh"
+#include "searchstats.hh"
+#include "trace.hh"
 
 template<typename T, typename F>
 optional<T> operator||(optional<T> first, F func) {
@@ -25,6 +35,30 @@ optional<T> operator||(optional<T> first, F func) {
   return func();
 }
 
+// The seed given as "--seed N" anywhere on the command line, else the one
+// at argv[index], else one from the clock when that is missing or "-".
+// The option is taken out of argv, so mains call this before reading
+// their other arguments. Binaries print the seed they use, so any run
+// can be repeated. A --seed without a value exits with a usage message.
+inline unsigned seed_argument(int& argc, char **argv, int index) {
+  for (int i = 1; i < argc; ++i) {
+    if (string(argv[i]) == "--seed") {
+      if (i + 1 == argc) {
+        cerr << "usage: " << argv[0] << " ... --seed N\n";
+        exit(1);
+      }
+      unsigned seed = stoul(argv[i + 1]);
+      copy(argv + i + 2, argv + argc + 1, argv + i);
+      argc -= 2;
+      return seed;
+    }
+  }
+  if (argc > index && string(argv[index]) != "-") {
+    return stoul(argv[index]);
+  }
+  return chrono::system_clock::now().time_since_epoch().count();
+}
+
 template<typename T>
 concept Strategy = requires (T x) {
   { x(Mark::X, bitset<125>()) } -> same_as<optional<Position>>;
@@ -33,6 +67,60 @@ concept Strategy = requires (T x) {
 template<int N, int D, Strategy S>
 class GameEngine;
 
+// Facts about one ply that several strategies of a Combiner chain ask
+// for, each computed on first use. Every strategy of a chain plays on
+// the same State.
+template<int N, int D>
+class PlyAnalysis {
+ public:
+  explicit PlyAnalysis(const Bitfield<N, D>& open_positions)
+      : open_positions(open_positions) {
+  }
+
+  const Bitfield<N, D>& get_open_positions() const {
+    return open_positions;
+  }
+
+  // Lowest open cell completing a line of mark.
+  optional<Position> win(const State<N, D>& state, Mark mark) {
+    return lowest(wins, mark, state.get_winning_cells(mark));
+  }
+
+  // Lowest open cell crossed by two lines holding N-2 of mark.
+  optional<Position> double_threat(const State<N, D>& state, Mark mark) {
+    return lowest(threats, mark, state.get_double_threats(mark));
+  }
+
+  const vector<Position>& open_vector() {
+    if (!enumerated) {
+      positions = open_positions.get_vector();
+      enumerated = true;
+    }
+    return positions;
+  }
+
+ private:
+  using Cache = array<optional<optional<Position>>, 2>;
+  const Bitfield<N, D>& open_positions;
+  Cache wins, threats;
+  bool enumerated = false;
+  vector<Position> positions;
+
+  optional<Position> lowest(
+      Cache& cache, Mark mark, const Bitfield<N, D>& cells) {
+    auto& known = cache[mark == Mark::X ? 0 : 1];
+    if (!known.has_value()) {
+      Bitfield<N, D> candidates = cells;
+      candidates &= open_positions;
+      known.emplace();
+      if (!candidates.none()) {
+        known->emplace(candidates.first());
+      }
+    }
+    return *known;
+  }
+};
+
 template<int N, int D>
 class ForcingMove {
  public:
@@ -44,15 +132,14 @@ class ForcingMove {
   optional<Position> find_forcing_move(
       Mark mark,
       const Bitfield<N, D>& open_positions) {
-    for (Line line : state.get_line_marks(MarkCount{N - 1}, mark)) {
-      Position trial = state.get_xor_table(line);
-      if (open_positions[trial]) {
-        return trial;
-      }
+    Bitfield<N, D> candidates = state.get_winning_cells(mark);
+    candidates &= open_positions;
+    if (candidates.none()) {
+      // Can't return directly because of g++ bug.
+      optional<Position> empty = {};
+      return empty;
     }
-    // Can't return directly because of g++ bug.
-    optional<Position> empty = {};
-    return empty;
+    return candidates.first();
   }
 
   template<typename B>
@@ -61,16 +148,68 @@ class ForcingMove {
         find_forcing_move(mark, open_positions) ||
         [&](){ return find_forcing_move(flip(mark), open_positions); };
   }
+
+  optional<Position> analyzed(Mark mark, PlyAnalysis<N, D>& analysis) {
+    return
+        analysis.win(state, mark) ||
+        [&](){ return analysis.win(state, flip(mark)); };
+  }
 };
 
+// Proven and refuted chains, keyed by position hash and side to move.
+// Shared by every ChainingStrategy of a search; cleared when full.
+class ChainingMemo {
+ public:
+  explicit ChainingMemo(int capacity = 1 << 20) : capacity(capacity) {
+  }
+
+  // Empty when unknown; otherwise the winning move, or nullopt inside
+  // when the position was refuted.
+  optional<optional<Position>> find(uint64_t hash, Mark mark) const {
+    lock_guard<mutex> guard(lock);
+    auto it = table.find(key(hash, mark));
+    if (it == table.end()) {
+      return {};
+    }
+    return it->second;
+  }
+
+  void insert(uint64_t hash, Mark mark, optional<Position> value) {
+    lock_guard<mutex> guard(lock);
+    if (static_cast<int>(table.size()) >= capacity) {
+      table.clear();
+    }
+    table[key(hash, mark)] = value;
+  }
+
+ private:
+  static uint64_t key(uint64_t hash, Mark mark) {
+    return mark == Mark::X ? hash : ~hash;
+  }
+
+  int capacity;
+  mutable mutex lock;
+  unordered_map<uint64_t, optional<Position>> table;
+};
+
+// Looks for a chain of threats on N-2 lines, each answered by a single
+// forced block, ending in a double threat. Depth-first with an explicit
+// stack; gives up (without memoizing) after max_nodes attacker moves.
 template<int N, int D, typename Print = decltype([](const State<N, D>& x){})>
 class ChainingStrategy {
  public:
-  explicit ChainingStrategy(const State<N, D>& state)
-    : state(state) {
+  explicit ChainingStrategy(
+      const State<N, D>& state,
+      ChainingMemo *memo = nullptr,
+      int max_nodes = numeric_limits<int>::max())
+    : state(state), memo(memo), max_nodes(max_nodes) {
   }
   const State<N, D>& state;
+  ChainingMemo *memo;
+  int max_nodes;
   int visited = 0;
+  int memo_hits = 0;
+  bool exhausted = false;
   constexpr static Line line_size = BoardData<N, D>::line_size;
 
   template<typename B>
@@ -79,52 +218,100 @@ class ChainingStrategy {
   }
 
   optional<Position> search(Mark mark) {
-    return search_current(state, mark);
-  }
-
-  optional<Position> search_current(const State<N, D>& current, Mark mark) {
-    visited++;
-    Print()(current);
-    for (Line line : current.get_line_marks(MarkCount{N - 1}, mark)) {
-      return current.get_xor_table(line);
-    }
-    if (!current.empty(MarkCount{N - 1}, flip(mark))) {
-      return {};
+    Print()(state);
+    if (auto settled = settle(state, mark); settled.has_value()) {
+      return *settled;
     }
-    for (const auto& line : current.get_line_marks(MarkCount{N - 2}, mark)) {
-      for (Position pos : current.get_line(line)) {
-        if (current.get_board(pos) == Mark::empty) {
-          State cloned(current);
-          cloned.play(pos, mark);
-          optional<Position> opponent = search_opponent(cloned, flip(mark));
-          if (opponent.has_value()) {
-            return pos;
+    vector<Frame> stack;
+    stack.push_back(Frame{state, candidates(state, mark)});
+    while (!stack.empty()) {
+      Frame& frame = stack.back();
+      if (frame.next == static_cast<int>(frame.moves.size())) {
+        remember(frame.state, mark, {});
+        stack.pop_back();
+        continue;
+      }
+      if (visited >= max_nodes) {
+        exhausted = true;
+        return {};
+      }
+      visited++;
+      Position pos = frame.moves[frame.next++];
+      State<N, D> cloned(frame.state);
+      Print()(cloned);
+      if (!cloned.play(pos, mark)) {
+        Mark opponent = flip(mark);
+        if (!cloned.get_winning_cells(opponent).none()) {
+          continue;
+        }
+        // Two lines completed by the same cell are still a single threat.
+        const auto& threats = cloned.get_winning_cells(mark);
+        if (threats.count() == 1) {
+          cloned.play(threats.first(), opponent);
+          auto settled = settle(cloned, mark);
+          if (!settled.has_value()) {
+            stack.push_back(Frame{cloned, candidates(cloned, mark)});
+            continue;
+          }
+          if (!settled->has_value()) {
+            continue;
           }
         }
       }
+      for (const auto& proven : stack) {
+        remember(proven.state, mark, proven.moves[proven.next - 1]);
+      }
+      return stack.front().moves[stack.front().next - 1];
     }
     return {};
   }
 
-  optional<Position> search_opponent(State<N, D>& current, Mark mark) {
-    visited++;
-    Print()(current);
-    if (!current.empty(MarkCount{N - 1}, mark)) {
-      return {};
+ private:
+  struct Frame {
+    State<N, D> state;
+    vector<Position> moves;
+    int next = 0;
+  };
+
+  // Answers known without searching: an open four wins, an opponent four
+  // refutes, and the memo may know the rest.
+  optional<optional<Position>> settle(const State<N, D>& current, Mark mark) {
+    if (const auto& wins = current.get_winning_cells(mark); !wins.none()) {
+      return make_optional(make_optional(wins.first()));
     }
-    if (!current.one(MarkCount{N - 1}, flip(mark))) {
-      Position dummy = 0_pos;
-      return dummy;
+    if (!current.get_winning_cells(flip(mark)).none()) {
+      return make_optional(optional<Position>{});
     }
-    Line line = *current.get_line_marks(MarkCount{N - 1}, flip(mark)).begin();
-    Position pos = current.get_xor_table(line);
-    current.play(pos, mark);
-    optional<Position> value = search_current(current, flip(mark));
-    if (value.has_value()) {
-      return pos;
+    if (memo != nullptr) {
+      if (auto known = memo->find(current.get_hash(), mark);
+          known.has_value()) {
+        memo_hits++;
+        return known;
+      }
     }
     return {};
   }
+
+  void remember(const State<N, D>& current, Mark mark,
+      optional<Position> value) {
+    if (memo != nullptr) {
+      memo->insert(current.get_hash(), mark, value);
+    }
+  }
+
+  vector<Position> candidates(const State<N, D>& current, Mark mark) const {
+    vector<Position> moves;
+    Bitfield<N, D> seen;
+    for (Line line : current.get_line_marks(MarkCount{N - 2}, mark)) {
+      for (Position pos : current.get_line(line)) {
+        if (current.get_board(pos) == Mark::empty && !seen[pos]) {
+          seen.set(pos);
+          moves.push_back(pos);
+        }
+      }
+    }
+    return moves;
+  }
 };
 
 template<int N, int D>
@@ -140,17 +327,14 @@ class ForcingStrategy {
 
   optional<Position> find_forcing_move(Mark mark,
       const Bitfield<N, D>& open_positions) {
-    for (Position pos : open_positions.all()) {
-      for (const auto& [line_a, line_b] : data.crossings()[pos]) {
-        if (state.check_line(line_a, MarkCount{N - 2}, mark) &&
-            state.check_line(line_b, MarkCount{N - 2}, mark)) {
-          return pos;
-        }
-      }
+    Bitfield<N, D> candidates = state.get_double_threats(mark);
+    candidates &= open_positions;
+    if (candidates.none()) {
+      // Can't return directly because of g++ bug.
+      optional<Position> empty = {};
+      return empty;
     }
-    // Can't return directly because of g++ bug.
-    optional<Position> empty = {};
-    return empty;
+    return candidates.first();
   }
 
   template<typename B>
@@ -159,6 +343,12 @@ class ForcingStrategy {
         find_forcing_move(mark, open_positions) ||
         [&](){ return find_forcing_move(flip(mark), open_positions); };
   }
+
+  optional<Position> analyzed(Mark mark, PlyAnalysis<N, D>& analysis) {
+    return
+        analysis.double_threat(state, mark) ||
+        [&](){ return analysis.double_threat(state, flip(mark)); };
+  }
 };
 
 template<int N, int D>
@@ -173,13 +363,45 @@ class BiasedRandom {
 
   template<typename B>
   optional<Position> operator()(Mark mark, const B& open_positions) {
+    uniform_int_distribution<int> random_position(
+        0, total_weight(open_positions) - 1);
+    return select(open_positions, random_position(generator));
+  }
+
+  // Picks the cell at the given fraction of the cumulative weight, so
+  // evenly spaced fractions give a stratified sample.
+  template<typename B>
+  Position stratified(const B& open_positions, double fraction) {
+    int total = total_weight(open_positions);
+    return select(open_positions,
+        min(total - 1, static_cast<int>(fraction * total)));
+  }
+
+  // When no symmetry is left to reduce, the open positions are exactly
+  // the non-dead empty cells, and dead cells have zero weight, so the
+  // incremental tree in State gives the same answer as the scans below.
+  template<typename B>
+  bool all_empty(const B& open_positions) const {
+    return static_cast<int>(open_positions.count()) == state.get_empty_count();
+  }
+
+  template<typename B>
+  int total_weight(const B& open_positions) const {
+    if (all_empty(open_positions)) {
+      return state.get_total_weight();
+    }
     auto open_pos = open_positions.all();
-    int total = accumulate(begin(open_pos), end(open_pos), 0,
+    return accumulate(begin(open_pos), end(open_pos), 0,
       [&](int a, auto pos) {
         return a + state.get_current_accumulation(pos);
       });
-    uniform_int_distribution<int> random_position(0, total - 1);
-    int chosen = random_position(generator);
+  }
+
+  template<typename B>
+  Position select(const B& open_positions, int chosen) const {
+    if (all_empty(open_positions)) {
+      return state.find_weight(chosen);
+    }
     int previous = 0;
     for (Position pos : open_positions.all()) {
       int current = previous + state.get_current_accumulation(pos);
@@ -192,6 +414,89 @@ class BiasedRandom {
   }
 };
 
+// Every open position equally likely, as Knuth's tree-size estimate
+// assumes.
+template<int N, int D>
+class UniformRandom {
+ public:
+  explicit UniformRandom(default_random_engine& generator)
+      : generator(generator) {
+  }
+  default_random_engine& generator;
+
+  template<typename B>
+  optional<Position> operator()(Mark mark, const B& open_positions) {
+    uniform_int_distribution<int> random_position(
+        0, open_positions.count() - 1);
+    int chosen = random_position(generator);
+    for (Position pos : open_positions.all()) {
+      if (chosen-- == 0) {
+        return pos;
+      }
+    }
+    return {};
+  }
+};
+
+// Rollout kernel equivalent to
+//   ForcingMove >> ForcingStrategy >> BiasedRandom
+// in a single strategy, reading the threats State keeps up to date as
+// marks are placed.
+template<int N, int D>
+class RolloutPolicy {
+ public:
+  RolloutPolicy(const State<N, D>& state, default_random_engine& generator)
+      : state(state), random(state, generator) {
+  }
+  const State<N, D>& state;
+  BiasedRandom<N, D> random;
+
+  template<typename B>
+  optional<Position> operator()(Mark mark, const B& open_positions) {
+    return
+        forced(mark, open_positions) ||
+        [&](){ return random(mark, open_positions); };
+  }
+
+  optional<Position> forced(Mark mark, const Bitfield<N, D>& open_positions) {
+    return
+        find_win(mark, open_positions) ||
+        [&](){ return find_win(flip(mark), open_positions); } ||
+        [&](){ return find_double_threat(mark, open_positions); } ||
+        [&](){ return find_double_threat(flip(mark), open_positions); };
+  }
+
+  // Same answer as ForcingMove: lowest open cell completing a line.
+  optional<Position> find_win(Mark mark, const Bitfield<N, D>& open_positions) {
+    Bitfield<N, D> candidates = state.get_winning_cells(mark);
+    candidates &= open_positions;
+    if (candidates.none()) {
+      optional<Position> empty = {};
+      return empty;
+    }
+    return candidates.first();
+  }
+
+  // Same answer as ForcingStrategy: lowest open cell crossed by two
+  // lines holding N-2 of mark and nothing else.
+  optional<Position> find_double_threat(
+      Mark mark, const Bitfield<N, D>& open_positions) {
+    Bitfield<N, D> candidates = state.get_double_threats(mark);
+    candidates &= open_positions;
+    if (candidates.none()) {
+      optional<Position> empty = {};
+      return empty;
+    }
+    return candidates.first();
+  }
+};
+
+// Strategies that can read shared facts from a PlyAnalysis.
+template<typename T, int N, int D>
+concept Analyzing = requires (T x, PlyAnalysis<N, D>& analysis) {
+  { x.analyzed(Mark::X, analysis) } -> same_as<optional<Position>>;
+};
+
 template<Strategy A, Strategy B>
 class Combiner {
  public:
@@ -204,6 +509,31 @@ class Combiner {
     return a(mark, open_positions) ||
         [&](){ return b(mark, open_positions); };
   }
+
+  // One analysis per ply, shared by every stage of the chain.
+  template<int N, int D>
+  optional<Position> operator()(
+      Mark mark, const Bitfield<N, D>& open_positions) {
+    PlyAnalysis<N, D> analysis(open_positions);
+    return analyzed(mark, analysis);
+  }
+
+  template<int N, int D>
+  optional<Position> analyzed(Mark mark, PlyAnalysis<N, D>& analysis) {
+    return stage(a, mark, analysis) ||
+        [&](){ return stage(b, mark, analysis); };
+  }
+
+ private:
+  template<typename S, int N, int D>
+  static optional<Position> stage(
+      S& strategy, Mark mark, PlyAnalysis<N, D>& analysis) {
+    if constexpr (Analyzing<S, N, D>) {
+      return strategy.analyzed(mark, analysis);
+    } else {
+      return strategy(mark, analysis.get_open_positions());
+    }
+  }
 };
 
 template<Strategy A, Strategy B>
@@ -211,6 +541,16 @@ constexpr auto operator>>(A a, B b) {
   return Combiner<A, B>(a, b);
 }
 
+// Variance reduction for HeatMap playouts.
+struct Sampling {
+  // Trial i of every candidate move uses the same random stream, so the
+  // noise mostly cancels when their scores are compared.
+  bool common_random = false;
+  // The opponent's first reply is drawn by systematic sampling over the
+  // BiasedRandom weights instead of independently in each trial.
+  bool stratified = false;
+};
+
 template<int N, int D>
 class HeatMap {
  public:
@@ -219,37 +559,85 @@ class HeatMap {
     const BoardData<N, D>& data,
     default_random_engine& generator,
     int trials,
-    bool print_board = false)
+    bool print_board = false,
+    int rave_equivalence = 0,
+    Sampling sampling = {})
       : state(state), data(data), generator(generator),
-        trials(trials), print_board(print_board) {
+        trials(trials), print_board(print_board),
+        rave_equivalence(rave_equivalence), sampling(sampling) {
   }
   const State<N, D>& state;
   const BoardData<N, D>& data;
   default_random_engine& generator;
   int trials;
   bool print_board;
+  // When positive, scores blend in AMAF statistics with this equivalence
+  // parameter and are reported in thousandths of a playout.
+  int rave_equivalence;
+  Sampling sampling;
+  // Standard error of each score from the last get_scores, in the same
+  // units as the score (direct playouts only).
+  vector<double> errors;
   constexpr static Line line_size = BoardData<N, D>::line_size;
   constexpr static Position board_size = BoardData<N, D>::board_size;
 
+  struct Playouts {
+    int score;
+    double error;
+    AmafTable<N, D> amaf;
+  };
+
   template<typename B>
   optional<Position> operator()(Mark mark, const B& open_positions) {
-    vector<Position> open = open_positions.get_vector();
+    return choose(mark, open_positions.get_vector());
+  }
+
+  optional<Position> analyzed(Mark mark, PlyAnalysis<N, D>& analysis) {
+    return choose(mark, analysis.open_vector());
+  }
+
+  optional<Position> choose(Mark mark, const vector<Position>& open) {
     vector<int> score = get_scores(mark, open);
+    auto winner = max_element(begin(score), end(score));
+    int best = distance(begin(score), winner);
     if (print_board) {
       vector<int> norm = normalize_score(score);
       print(open, norm);
+      cout << "best " << *winner << " +- " << errors[best] << "\n";
     }
-    auto winner = max_element(begin(score), end(score));
-    return open[distance(begin(score), winner)];
+    return open[best];
   }
 
   vector<int> get_scores(Mark mark, const vector<Position>& open) {
+    METRIC_ADD(heatmap_calls, 1);
     Mark flipped = flip(mark);
-    vector<int> score(open.size());
-    transform(execution::par_unseq, begin(open), end(open), begin(score),
+    unsigned seed = generator();
+    vector<Playouts> playouts(open.size());
+    transform(execution::par_unseq, begin(open), end(open), begin(playouts),
         [&](Position pos) {
-      return monte_carlo(mark, flipped, pos);
+      TRACE_SCOPE("monte_carlo");
+      MEMORY_SCOPE(heatmap);
+      return monte_carlo(mark, flipped, pos, seed);
     });
+    vector<int> score(open.size());
+    errors.resize(open.size());
+    if (rave_equivalence == 0) {
+      for (int i = 0; i < static_cast<int>(open.size()); ++i) {
+        score[i] = playouts[i].score;
+        errors[i] = trials * playouts[i].error;
+      }
+      return score;
+    }
+    AmafTable<N, D> amaf;
+    for (const auto& p : playouts) {
+      amaf += p.amaf;
+    }
+    for (int i = 0; i < static_cast<int>(open.size()); ++i) {
+      double direct = static_cast<double>(playouts[i].score) / trials;
+      double blended = amaf.blend(open[i], direct, trials, rave_equivalence);
+      score[i] = static_cast<int>(lround(1000.0 * blended));
+      errors[i] = 1000.0 * playouts[i].error;
+    }
     return score;
   }
 
@@ -267,21 +655,78 @@ class HeatMap {
     return norm;
   }
 
-  int monte_carlo(Mark mark, Mark flipped, Position pos) {
+  Playouts monte_carlo(Mark mark, Mark flipped, Position pos, unsigned seed) {
     array<int, 3> win_counts = {0, 0, 0};
+    Playouts ans;
+    vector<pair<Mark, Position>> moves;
+    // With common random numbers every candidate takes its offset from
+    // the seed and replays trial i from (seed, i). Otherwise candidates,
+    // which run in parallel, each draw from a stream of their own rather
+    // than the shared generator; that keeps seeded runs repeatable.
+    default_random_engine rng;
+    if (sampling.common_random) {
+      seed_seq shared_seed{seed};
+      rng.seed(shared_seed);
+    } else {
+      seed_seq own_seed{seed, static_cast<unsigned>(pos), 1u};
+      rng.seed(own_seed);
+    }
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    double offset = unit(rng);
     for (int i = 0; i < trials; ++i) {
+      if (sampling.common_random) {
+        // Consecutive raw seeds give correlated LCG streams, so mix them.
+        seed_seq trial_seed{seed, static_cast<unsigned>(i)};
+        rng.seed(trial_seed);
+      }
       State<N, D> cloned(state);
       cloned.play(pos, mark);
-      auto s =
-          ForcingMove<N, D>(cloned) >>
-          ForcingStrategy<N, D>(cloned, data) >>
-          BiasedRandom<N, D>(cloned, generator);
-      GameEngine engine(generator, cloned, s);
-      Mark winner = engine.play(flipped);
+      moves.assign(1, make_pair(mark, pos));
+      Mark winner = sampling.stratified ?
+          stratified_rollout(
+              cloned, mark, flipped, rng, (i + offset) / trials, moves) :
+          rollout(cloned, flipped, rng, moves);
+      if (rave_equivalence > 0) {
+        ans.amaf.update(mark, winner, moves);
+      }
       win_counts[static_cast<int>(winner)]++;
     }
-    return win_counts[static_cast<int>(mark)] -
-           win_counts[static_cast<int>(flipped)];
+    int wins = win_counts[static_cast<int>(mark)];
+    int losses = win_counts[static_cast<int>(flipped)];
+    ans.score = wins - losses;
+    // Each playout scores +1, 0 or -1.
+    double mean = static_cast<double>(ans.score) / trials;
+    double variance = static_cast<double>(wins + losses) / trials - mean * mean;
+    ans.error = sqrt(max(0.0, variance) / trials);
+    return ans;
+  }
+
+  Mark rollout(State<N, D>& cloned, Mark start, default_random_engine& rng,
+      vector<pair<Mark, Position>>& moves) {
+    GameEngine engine(rng, cloned, RolloutPolicy<N, D>(cloned, rng));
+    if (rave_equivalence > 0) {
+      return engine.play(start, [](auto x){}, MoveRecorder(start, moves));
+    }
+    return engine.play(start);
+  }
+
+  Mark stratified_rollout(State<N, D>& cloned, Mark mark, Mark flipped,
+      default_random_engine& rng, double fraction,
+      vector<pair<Mark, Position>>& moves) {
+    auto open_positions = cloned.get_open_positions(flipped);
+    if (open_positions.none()) {
+      return Mark::empty;
+    }
+    RolloutPolicy<N, D> policy(cloned, rng);
+    optional<Position> reply = policy.forced(flipped, open_positions);
+    if (!reply.has_value()) {
+      reply = policy.random.stratified(open_positions, fraction);
+    }
+    moves.emplace_back(flipped, *reply);
+    if (cloned.play(*reply, flipped)) {
+      return flipped;
+    }
+    return rollout(cloned, mark, rng, moves);
   }
 
   void print(const vector<Position>& open, const vector<int>& norm) {
@@ -341,9 +786,14 @@ class MiniMax {
   explicit MiniMax(
     const State<N, D>& state,
     const BoardData<N, D>& data,
-    default_random_engine& generator)
+    default_random_engine& generator,
+    bool threat_space = false,
+    const Tablebase<N, D>* tablebase = nullptr)
     :  state(state), data(data), generator(generator),
-       nodes_visited(0) {
+       nodes_visited(0), heat_cache(data), threat_space(threat_space),
+       threat_nodes(0), threat_hits(0), chaining_budget(1 << 20),
+       chaining_nodes(0), chaining_memo_hits(0), chaining_exhausted(0),
+       max_visited(0), tablebase(tablebase), tablebase_hits(0) {
   }
   const State<N, D>& state;
   const BoardData<N, D>& data;
@@ -351,6 +801,23 @@ class MiniMax {
   int nodes_visited;
   vector<int> rank;
   SolutionTree solution;
+  HeatMapCache<N, D> heat_cache;
+  bool threat_space;
+  long long threat_nodes;
+  int threat_hits;
+  ChainingMemo chaining_memo;
+  int chaining_budget;
+  long long chaining_nodes;
+  int chaining_memo_hits;
+  int chaining_exhausted;
+  int max_visited;
+  // Positions the table knows are not searched; their nodes keep only the
+  // table's line of best moves.
+  const Tablebase<N, D>* tablebase;
+  int tablebase_hits;
+  SearchStats stats;
+  // Where the tree goes when a memory cap stops the search.
+  string partial_solution = "solution.partial.txt";
   constexpr static Position board_size = BoardData<N, D>::board_size;
 
   optional<BoardValue> play(State<N, D>& current_state, Mark mark) {
@@ -358,6 +825,20 @@ class MiniMax {
         winner(flip(mark)), solution.get_root());
     cout << "Total nodes visited: " << nodes_visited << "\n";
     cout << "Nodes in solution tree: " << solution.get_root()->count << "\n";
+    cout << "Heatmap cache hits: " << heat_cache.get_hits()
+         << " misses: " << heat_cache.get_misses() << "\n";
+    if (threat_space) {
+      cout << "Threat-space nodes: " << threat_nodes
+           << " wins found: " << threat_hits << "\n";
+    } else {
+      cout << "Chaining nodes: " << chaining_nodes
+           << " memo hits: " << chaining_memo_hits
+           << " out of budget: " << chaining_exhausted << "\n";
+    }
+    if (tablebase != nullptr) {
+      cout << "Tablebase hits: " << tablebase_hits << "\n";
+    }
+    MEMORY_PRINT(cout);
     return ans;
   }
 
@@ -365,28 +846,64 @@ class MiniMax {
     return solution;
   }
 
+  const SearchStats& get_stats() const {
+    return stats;
+  }
+
   optional<BoardValue> play(
       State<N, D>& current_state, Mark mark, BoardValue parent,
       SolutionTree::Node *node) {
+    TRACE_SCOPE("play");
+    MEMORY_SCOPE(minimax);
     auto open_positions = current_state.get_open_positions(mark);
     report_progress(open_positions);
+    int depth = rank.size(), open_count = open_positions.count();
+    stats.add(depth, open_count, [&](auto& level) {
+      level.nodes++;
+      level.open += open_count;
+    });
     if (open_positions.none()) {
       return node->value = BoardValue::DRAW;
     }
+    if (tablebase != nullptr) {
+      if (auto known = tablebase->probe(current_state, mark);
+          known.has_value()) {
+        tablebase_hits++;
+        stats.add(depth, open_count, [](auto& level) {
+          level.tablebase_hits++;
+        });
+        follow_tablebase(current_state, mark, node, *known);
+        return node->value = *known;
+      }
+    }
     if (auto forced = check_forced_move(
            current_state, mark, parent, open_positions, node);
         forced.has_value()) {
-      return node->value = winner(mark);
+      return node->value = *forced;
     }
     vector<Position> open = open_positions.get_vector();
-    vector<pair<int, Position>> sorted = get_sorted_positions(open, mark);
+    vector<pair<int, Position>> sorted =
+        get_sorted_positions(current_state, open, mark);
     BoardValue current_best = winner(flip(mark));
+    stats.add(depth, open_count, [](auto& level) {
+      level.expanded++;
+    });
+    auto cutoff = [&](int rank_value) {
+      stats.add(depth, open_count, [&](auto& level) {
+        level.cutoffs++;
+        SearchStats::add_rank(level, rank_value);
+      });
+    };
     for (int rank_value = 0; const auto& [score, pos] : sorted) {
-      node->children.emplace_back(pos, make_unique<SolutionTree::Node>());
-      auto *child_node = node->get_last_child();
+      auto *child_node = node->add_child(pos);
       State<N, D> cloned(current_state);
       bool result = cloned.play(pos, mark);
+      stats.add(depth, open_count, [](auto& level) {
+        level.children++;
+      });
       if (result) {
+        cutoff(rank_value);
+        child_node->value = winner(mark);
         node->count += count_children(node);
         return node->value = winner(mark);
       } else {
@@ -398,6 +915,7 @@ class MiniMax {
         auto final_result = process_result(
             new_result, mark, parent, current_best);
         if (final_result.has_value()) {
+          cutoff(rank_value);
           node->count += count_children(node);
           return node->value = *final_result;
         }
@@ -412,6 +930,33 @@ class MiniMax {
     return mark == Mark::X ? BoardValue::X_WIN : BoardValue::O_WIN;
   }
 
+  // A node decided without searching its children still records the
+  // move that decides it, as a leaf child with the node's value, so
+  // every decided node of the tree names a move.
+  BoardValue settle(SolutionTree::Node *node, Position pos, BoardValue value) {
+    node->add_child(pos)->value = value;
+    node->count += count_children(node);
+    return value;
+  }
+
+  // Records the table's best moves from a probed node to the end of the
+  // game, so the nodes below a probe name their moves as well. They are
+  // not probes of their own and add no tablebase hits.
+  void follow_tablebase(State<N, D> state, Mark mark,
+      SolutionTree::Node *node, BoardValue value) {
+    auto best = TablebaseStrategy(state, *tablebase)(
+        mark, state.get_open_positions(mark));
+    if (!best.has_value()) {
+      return;
+    }
+    auto *child_node = node->add_child(*best);
+    child_node->value = value;
+    if (!state.play(*best, mark)) {
+      follow_tablebase(state, flip(mark), child_node, value);
+    }
+    node->count += count_children(node);
+  }
+
   int count_children(SolutionTree::Node *parent) {
     return accumulate(begin(parent->children), end(parent->children), 0,
       [](auto a, auto& b) {
@@ -443,12 +988,13 @@ class MiniMax {
   }
 
   vector<pair<int, Position>> get_sorted_positions(
-      const vector<Position>& open, Mark mark) {
+      const State<N, D>& current_state, const vector<Position>& open,
+      Mark mark) {
     vector<pair<int, Position>> paired(open.size());
     if (open.size() < 9) {
       uniform_positions(paired, open);
     } else {
-      heatmap_positions(paired, open, mark);
+      heatmap_positions(current_state, paired, open, mark);
     }
     return paired;
   }
@@ -460,19 +1006,37 @@ class MiniMax {
     }
   }
 
-  void heatmap_positions(vector<pair<int, Position>>& paired,
+  void heatmap_positions(const State<N, D>& current_state,
+      vector<pair<int, Position>>& paired,
       const vector<Position>& open, Mark mark) {
-    int trials = 20 * open.size();
-    HeatMap<N, D> heatmap(state, data, generator, trials);
-    vector<int> scores = heatmap.get_scores(mark, open);
+    TRACE_SCOPE("heatmap_positions");
+    MEMORY_SCOPE(heatmap);
+    auto start = chrono::steady_clock::now();
+    vector<int> scores = heat_cache.get_scores(current_state, mark, open,
+        [&](const vector<Position>& positions) {
+      int trials = 5 * positions.size();
+      HeatMap<N, D> heatmap(
+          current_state, data, generator, trials, false, 1000);
+      return heatmap.get_scores(mark, positions);
+    });
     for (int i = 0; i < static_cast<int>(open.size()); ++i) {
       paired[i] = make_pair(scores[i], open[i]);
     }
     sort(rbegin(paired), rend(paired));
+    long long nanos = chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - start).count();
+    stats.add(rank.size(), open.size(), [&](auto& level) {
+      level.heatmap_calls++;
+      level.heatmap_nanos += nanos;
+    });
   }
 
+  // With METRICS the reporter thread prints progress instead.
   template<typename B>
   void report_progress(const B& open_positions) {
+    METRIC_ADD(nodes, 1);
+    METRIC_SET(depth, rank.size());
+#ifndef METRICS
     if ((nodes_visited % 1000) == 0) {
       cout << "id " << nodes_visited << " " << open_positions.count() << endl;
       cout << "rank ";
@@ -480,34 +1044,79 @@ class MiniMax {
         cout << i <<  " ";
       }
       cout << "\n";
+      MEMORY_PRINT(cout);
+    }
+#endif
+    if (MEMORY_OVER_CAP()) {
+      memory_cap_reached();
     }
     nodes_visited++;
   }
 
+  // Some subsystem went over its memory cap (memory.hh). Keeps the part
+  // of the solution tree found so far, or aborts when there is nowhere
+  // to write it.
+  void memory_cap_reached() {
+    cout.flush();
+    cerr << "memory cap exceeded after " << nodes_visited << " nodes\n";
+    MEMORY_PRINT(cerr);
+    if (partial_solution.empty()) {
+      abort();
+    }
+    solution.dump(data, partial_solution);
+    exit(3);
+  }
+
   template<typename B>
   optional<BoardValue> check_forced_move(
       State<N, D>& current_state, Mark mark, BoardValue parent,
       const B& open_positions, SolutionTree::Node *node) {
-    auto c = ChainingStrategy(current_state);
-    auto pos = c.search(mark);
-    static int max_visited = 0;
-    if (c.visited > max_visited) {
-      max_visited = c.visited;
-      cout << "new record " << max_visited << endl;
-    }
-    if (pos.has_value()) {
-      return winner(mark);
+    TRACE_SCOPE("check_forced_move");
+    int depth = rank.size(), open_count = open_positions.count();
+    auto count = [&](auto update) {
+      stats.add(depth, open_count, update);
+    };
+    count([](auto& level) { level.chaining_calls++; });
+    if (threat_space) {
+      ThreatSpaceSearch<N, D> t(current_state, data);
+      auto threat = t.search(mark);
+      threat_nodes += t.visited;
+      if (threat.has_value()) {
+        threat_hits++;
+        count([](auto& level) { level.chaining_wins++; });
+        return settle(node, *threat, winner(mark));
+      }
+    } else {
+      auto c = ChainingStrategy(
+          current_state, &chaining_memo, chaining_budget);
+      auto pos = c.search(mark);
+      chaining_nodes += c.visited;
+      chaining_memo_hits += c.memo_hits;
+      chaining_exhausted += c.exhausted;
+      METRIC_ADD(chaining_nodes, c.visited);
+      METRIC_MAX(chaining_record, c.visited);
+      if (c.visited > max_visited) {
+        max_visited = c.visited;
+#ifndef METRICS
+        cout << "new record " << max_visited << endl;
+#endif
+      }
+      if (pos.has_value()) {
+        count([](auto& level) { level.chaining_wins++; });
+        return settle(node, *pos, winner(mark));
+      }
     }
-    auto s = ForcingMove<N, D>(state);
+    auto s = ForcingMove<N, D>(current_state);
     auto forcing = s(mark, open_positions);
     if (forcing.has_value()) {
+      METRIC_ADD(forced_moves, 1);
+      count([](auto& level) { level.forced++; });
       State<N, D> cloned(current_state);
       if (cloned.play(*forcing, mark)) {
-        return winner(mark);
+        return settle(node, *forcing, winner(mark));
       }
       rank.push_back(-1);
-      node->children.emplace_back(*forcing, make_unique<SolutionTree::Node>());
-      auto *child_node = node->get_last_child();
+      auto *child_node = node->add_child(*forcing);
       auto result = play(cloned, flip(mark), parent, child_node);
       node->count += count_children(node);
       node->value = *result;
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
+#include "selfplay.hh"
+#include "tournament.hh"
+
+template<int N, int D>
+int tournament(const vector<string>& chains, int games, unsigned seed,
+    int threads) {
+  BoardData<N, D> data;
+  Tournament<N, D> tournament(data, seed, threads);
+  for (const auto& chain : chains) {
+    bool known = with_named_chain(data, chain, [&](auto make_strategy) {
+      tournament.add(chain, [make_strategy](
+          const State<N, D>& state, default_random_engine& generator) {
+        return typename Tournament<N, D>::Player(
+            make_strategy(state, generator));
+      });
+    });
+    if (!known) {
+      cerr << "unknown chain " << chain << "\n";
+      return 1;
+    }
+  }
+  auto start = chrono::steady_clock::now();
+  tournament.play(games);
+  auto end = chrono::steady_clock::now();
+  cout << N << "^" << D << " round robin, " << games << " games per pair, "
+       << "seed " << seed << ", "
+       << chrono::duration<double>(end - start).count() << "s\n\n";
+  tournament.print(cout);
+  return 0;
+}
+
+// Usage: tournament board games seed threads chain chain...
+// Board is one of 3x3, 4x4, 3x3x3, 4x4x4, 5x5x5; chains are named as in
+// selfplay, e.g. tournament 4x4x4 100 1 0 forcing chaining heatmap:50
+// (0 threads means one per core). The seed may also be given as
+// --seed N, or as "-" for one from the clock.
+int main(int argc, char **argv) {
+  unsigned seed = seed_argument(argc, argv, 3);
+  if (argc < 7) {
+    cerr << "usage: tournament board games seed threads chain chain...\n";
+    return 1;
+  }
+  string board = argv[1];
+  int games = stoi(argv[2]);
+  int threads = stoi(argv[4]);
+  if (threads == 0) {
+    threads = thread::hardware_concurrency();
+  }
+  vector<string> chains(argv + 5, argv + argc);
+  if (board == "3x3") {
+    return tournament<3, 2>(chains, games, seed, threads);
+  } else if (board == "4x4") {
+    return tournament<4, 2>(chains, games, seed, threads);
+  } else if (board == "3x3x3") {
+    return tournament<3, 3>(chains, games, seed, threads);
+  } else if (board == "4x4x4") {
+    return tournament<4, 3>(chains, games, seed, threads);
+  } else if (board == "5x5x5") {
+    return tournament<5, 3>(chains, games, seed, threads);
+  }
+  cerr << "unknown board " << board << "\n";
+  return 1;
+}
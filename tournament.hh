@@ -0,0 +1,231 @@
+#ifndef TOURNAMENT_HH
+#define TOURNAMENT_HH
+
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "tictactoe.hh"
+
+struct EloRating {
+  double elo;
+  // Half width of the 95% interval, from the curvature of the likelihood.
+  double error;
+};
+
+// Maximum likelihood Elo ratings from a cross table, where points[i][j]
+// is what i scored against j in games[i][j] games (a draw is half a
+// point). Every pair that met gets one extra virtual draw, so a perfect
+// score still has a finite rating. Ratings average zero.
+inline vector<EloRating> elo_ratings(
+    const vector<vector<double>>& points,
+    const vector<vector<int>>& games) {
+  int players = points.size();
+  vector<vector<double>> s(points), n(players, vector<double>(players));
+  for (int i = 0; i < players; ++i) {
+    for (int j = 0; j < players; ++j) {
+      n[i][j] = games[i][j];
+      if (i != j && games[i][j] > 0) {
+        s[i][j] += 0.5;
+        n[i][j] += 1.0;
+      }
+    }
+  }
+  vector<double> r(players), curvature(players);
+  auto expected = [&](int i, int j) {
+    return 1.0 / (1.0 + exp(r[j] - r[i]));
+  };
+  // Newton steps one player at a time; a round robin converges quickly.
+  for (int iteration = 0; iteration < 200; ++iteration) {
+    for (int i = 0; i < players; ++i) {
+      double gradient = 0.0;
+      curvature[i] = 0.0;
+      for (int j = 0; j < players; ++j) {
+        if (i != j && n[i][j] > 0) {
+          double p = expected(i, j);
+          gradient += s[i][j] - n[i][j] * p;
+          curvature[i] += n[i][j] * p * (1.0 - p);
+        }
+      }
+      if (curvature[i] > 0.0) {
+        r[i] += gradient / curvature[i];
+      }
+    }
+    double mean = accumulate(begin(r), end(r), 0.0) / players;
+    for (double& x : r) {
+      x -= mean;
+    }
+  }
+  const double scale = 400.0 / log(10.0);
+  vector<EloRating> ratings(players);
+  for (int i = 0; i < players; ++i) {
+    ratings[i].elo = scale * r[i];
+    ratings[i].error = curvature[i] > 0.0 ?
+        1.96 * scale / sqrt(curvature[i]) : numeric_limits<double>::infinity();
+  }
+  return ratings;
+}
+
+// Round robin between strategy chains, played on every core. A player
+// is a factory building its chain for a State and generator, as
+// GameEngine callers do.
+template<int N, int D>
+class Tournament {
+ public:
+  using Player = function<optional<Position>(Mark, const Bitfield<N, D>&)>;
+  using Factory = function<Player(const State<N, D>&, default_random_engine&)>;
+
+  Tournament(const BoardData<N, D>& data, unsigned seed,
+      int threads = thread::hardware_concurrency())
+      : data(data), seed(seed), threads(max(threads, 1)) {
+  }
+
+  void add(const string& name, Factory factory) {
+    names.push_back(name);
+    factories.push_back(factory);
+  }
+
+  // Every pair meets games_per_pair times, each side taking X in half of
+  // them. Game t of the schedule draws its moves from a generator seeded
+  // by (seed, t), so results do not depend on the thread count.
+  void play(int games_per_pair) {
+    int players = names.size();
+    points.assign(players, vector<double>(players));
+    games.assign(players, vector<int>(players));
+    nanos.assign(players, 0);
+    moves.assign(players, 0);
+    vector<tuple<int, int>> schedule;
+    for (int i = 0; i < players; ++i) {
+      for (int j = i + 1; j < players; ++j) {
+        for (int k = 0; k < games_per_pair; ++k) {
+          schedule.emplace_back(k % 2 == 0 ? i : j, k % 2 == 0 ? j : i);
+        }
+      }
+    }
+    vector<thread> workers;
+    for (int worker = 0; worker < threads; ++worker) {
+      workers.emplace_back([&, worker] {
+        play_games(schedule, worker);
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  const vector<string>& get_names() const {
+    return names;
+  }
+
+  // Points of i against j.
+  const vector<vector<double>>& get_points() const {
+    return points;
+  }
+
+  const vector<vector<int>>& get_games() const {
+    return games;
+  }
+
+  double move_time(int player) const {
+    return moves[player] == 0 ? 0.0 :
+        static_cast<double>(nanos[player]) / moves[player];
+  }
+
+  vector<EloRating> ratings() const {
+    return elo_ratings(points, games);
+  }
+
+  // Players sorted by rating, then the cross table of scores in percent.
+  void print(ostream& os) const {
+    auto elo = ratings();
+    int players = names.size();
+    vector<int> order(players);
+    iota(begin(order), end(order), 0);
+    sort(begin(order), end(order), [&](int a, int b) {
+      return elo[a].elo > elo[b].elo;
+    });
+    os << fixed << setprecision(1);
+    os << "rank  elo          score   games  us/move  chain\n";
+    for (int rank = 0; rank < players; ++rank) {
+      int i = order[rank];
+      double scored = accumulate(begin(points[i]), end(points[i]), 0.0);
+      int played = accumulate(begin(games[i]), end(games[i]), 0);
+      os << setw(4) << rank + 1 << "  " << setw(6) << elo[i].elo
+         << " +-" << setw(5) << elo[i].error << "  "
+         << setw(5) << 100.0 * scored / max(played, 1) << "%  "
+         << setw(6) << played << "  " << setw(7) << move_time(i) / 1e3
+         << "  " << names[i] << "\n";
+    }
+    os << "\n";
+    for (int i : order) {
+      for (int j : order) {
+        if (i == j || games[i][j] == 0) {
+          os << "     -";
+        } else {
+          os << setw(6) << 100.0 * points[i][j] / games[i][j];
+        }
+      }
+      os << "  " << names[i] << "\n";
+    }
+    os << defaultfloat;
+  }
+
+ private:
+  void play_games(const vector<tuple<int, int>>& schedule, int worker) {
+    int players = names.size();
+    vector<vector<double>> local_points(players, vector<double>(players));
+    vector<vector<int>> local_games(players, vector<int>(players));
+    vector<long long> local_nanos(players), local_moves(players);
+    for (int t = worker; t < static_cast<int>(schedule.size());
+         t += threads) {
+      auto [x, o] = schedule[t];
+      seed_seq sequence{seed, static_cast<unsigned>(t)};
+      default_random_engine generator(sequence);
+      State<N, D> state(data);
+      Player x_player = factories[x](state, generator);
+      Player o_player = factories[o](state, generator);
+      GameEngine engine(generator, state,
+          [&](Mark mark, const auto& open_positions) -> optional<Position> {
+        int player = mark == Mark::X ? x : o;
+        auto start = chrono::steady_clock::now();
+        auto move = (mark == Mark::X ? x_player : o_player)(
+            mark, open_positions);
+        auto end = chrono::steady_clock::now();
+        local_nanos[player] += chrono::duration_cast<chrono::nanoseconds>(
+            end - start).count();
+        local_moves[player]++;
+        return move;
+      });
+      Mark winner = engine.play(Mark::X);
+      double x_points = winner == Mark::X ? 1.0 :
+                        winner == Mark::O ? 0.0 : 0.5;
+      local_points[x][o] += x_points;
+      local_points[o][x] += 1.0 - x_points;
+      local_games[x][o]++;
+      local_games[o][x]++;
+    }
+    lock_guard<mutex> guard(lock);
+    for (int i = 0; i < players; ++i) {
+      for (int j = 0; j < players; ++j) {
+        points[i][j] += local_points[i][j];
+        games[i][j] += local_games[i][j];
+      }
+      nanos[i] += local_nanos[i];
+      moves[i] += local_moves[i];
+    }
+  }
+
+  const BoardData<N, D>& data;
+  unsigned seed;
+  int threads;
+  vector<string> names;
+  vector<Factory> factories;
+  mutex lock;
+  vector<vector<double>> points;
+  vector<vector<int>> games;
+  vector<long long> nanos, moves;
+};
+
+#endif
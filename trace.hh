@@ -0,0 +1,156 @@
+#ifndef TRACE_HH
+#define TRACE_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "boarddata.hh"
+
+// Scoped trace points written as Chrome trace events (load the file in
+// chrome://tracing or Perfetto). Like metrics.hh, everything compiles to
+// nothing unless TRACE is defined.
+
+#ifdef TRACE
+
+// Each thread appends completed scopes to a buffer of its own; only the
+// count is published, so writers never lock. Scopes are recorded only
+// inside sampling windows, window out of every period, which keeps
+// whole call stacks in each window and bounds the overhead and size of
+// long runs. A full buffer drops further events.
+class Tracer {
+ public:
+  struct Event {
+    const char *name;
+    uint64_t start, duration;
+  };
+
+  struct Buffer {
+    // Left uninitialized, so pages are only touched as events arrive.
+    Buffer(int tid, size_t capacity)
+        : tid(tid), capacity(capacity), events(new Event[capacity]),
+          size(0) {
+    }
+    int tid;
+    size_t capacity;
+    unique_ptr<Event[]> events;
+    atomic<size_t> size;
+    long long dropped = 0;
+  };
+
+  static Tracer& instance() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  static Buffer& local() {
+    thread_local Buffer *buffer = instance().allocate();
+    return *buffer;
+  }
+
+  // Nanoseconds since the tracer started.
+  uint64_t now() const {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - epoch).count();
+  }
+
+  bool sampling(uint64_t time) const {
+    return time % period < window;
+  }
+
+  void configure(chrono::milliseconds window, chrono::milliseconds period,
+      size_t capacity = 1 << 20) {
+    this->window = chrono::nanoseconds(window).count();
+    this->period = chrono::nanoseconds(period).count();
+    this->capacity = capacity;
+  }
+
+  // Call once the traced threads are idle.
+  void write(const string& filename) {
+    lock_guard<mutex> guard(lock);
+    ofstream ofs(filename);
+    ofs << "{\"traceEvents\": [";
+    bool first = true;
+    long long dropped = 0;
+    for (const auto& buffer : buffers) {
+      size_t size = buffer->size.load(memory_order_acquire);
+      for (size_t i = 0; i < size; ++i) {
+        const Event& event = buffer->events[i];
+        ofs << (first ? "\n" : ",\n") << "{\"name\": \"" << event.name
+            << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+            << ", \"ts\": " << event.start / 1000.0
+            << ", \"dur\": " << event.duration / 1000.0 << "}";
+        first = false;
+      }
+      dropped += buffer->dropped;
+    }
+    ofs << "\n], \"otherData\": {\"dropped\": " << dropped << "}}\n";
+  }
+
+ private:
+  Tracer()
+      : epoch(chrono::steady_clock::now()), window(1), period(1),
+        capacity(1 << 20) {
+  }
+
+  Buffer *allocate() {
+    lock_guard<mutex> guard(lock);
+    buffers.push_back(make_unique<Buffer>(buffers.size(), capacity));
+    return buffers.back().get();
+  }
+
+  chrono::steady_clock::time_point epoch;
+  uint64_t window, period;
+  size_t capacity;
+  mutex lock;
+  deque<unique_ptr<Buffer>> buffers;
+};
+
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name)
+      : name(name), start(Tracer::instance().now()) {
+  }
+
+  ~TraceScope() {
+    Tracer& tracer = Tracer::instance();
+    if (!tracer.sampling(start)) {
+      return;
+    }
+    uint64_t end = tracer.now();
+    Tracer::Buffer& buffer = Tracer::local();
+    size_t size = buffer.size.load(memory_order_relaxed);
+    if (size == buffer.capacity) {
+      buffer.dropped++;
+      return;
+    }
+    buffer.events[size] = Tracer::Event{name, start, end - start};
+    buffer.size.store(size + 1, memory_order_release);
+  }
+
+ private:
+  const char *name;
+  uint64_t start;
+};
+
+#define TRACE_JOIN(a, b) a##b
+#define TRACE_NAME(line) TRACE_JOIN(trace_scope_, line)
+#define TRACE_SCOPE(name) TraceScope TRACE_NAME(__LINE__)(name)
+#define TRACE_CONFIGURE(window, period) \
+  Tracer::instance().configure(window, period)
+#define TRACE_WRITE(filename) Tracer::instance().write(filename)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_CONFIGURE(window, period) do {} while (0)
+#define TRACE_WRITE(filename) do {} while (0)
+
+#endif
+
+#endif